@@ -0,0 +1,279 @@
+// Host benchmark of the DSMR parser. Replays the telegrams in telegrams/
+// (or the files given on the command line) through every stage of
+// handling a telegram, and reports the time, throughput and heap
+// allocations per telegram for each.
+
+#include <Arduino.h>
+
+#include "parser.h"
+#include "fields.h"
+
+#ifdef DSMR_BENCH_DECRYPT
+#include "decryptor.h"
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <string>
+#include <vector>
+
+HardwareSerial Serial;
+
+using namespace dsmr::fields;
+
+// Every field
+using AllFields = dsmr::ParsedData<
+    identification, p1_version, p1_version_be, timestamp, equipment_id, energy_delivered_lux, energy_delivered_tariff1,
+    energy_delivered_tariff2, energy_returned_lux, energy_returned_tariff1, energy_returned_tariff2,
+    total_imported_energy, total_exported_energy, electricity_tariff, power_delivered, power_returned,
+    reactive_power_delivered, reactive_power_returned, electricity_threshold, electricity_switch_position,
+    electricity_failures, electricity_long_failures, electricity_failure_log, electricity_sags_l1, electricity_sags_l2,
+    electricity_sags_l3, electricity_swells_l1, electricity_swells_l2, electricity_swells_l3, message_short,
+    message_long, voltage_l1, voltage_l2, voltage_l3, current_l1, current_l2, current_l3, power_delivered_l1,
+    power_delivered_l2, power_delivered_l3, power_returned_l1, power_returned_l2, power_returned_l3,
+    reactive_power_delivered_l1, reactive_power_delivered_l2, reactive_power_delivered_l3, reactive_power_returned_l1,
+    reactive_power_returned_l2, reactive_power_returned_l3, gas_device_type, gas_equipment_id, gas_equipment_id_be,
+    gas_valve_position, gas_delivered, gas_delivered_be, thermal_device_type, thermal_equipment_id,
+    thermal_valve_position, thermal_delivered, water_device_type, water_equipment_id, water_valve_position,
+    water_delivered, slave_device_type, slave_equipment_id, slave_valve_position, slave_delivered>;
+
+// A few fields, like a typical configuration that only has the energy
+// and power sensors
+using FewFields =
+    dsmr::ParsedData<energy_delivered_tariff1, energy_delivered_tariff2, power_delivered, gas_delivered, voltage_l1>;
+
+// Each stage is repeated until it took at least this long
+static constexpr std::chrono::nanoseconds MIN_TIME = std::chrono::milliseconds(100);
+
+// Heap allocations, counted by the operator new below
+static size_t allocations = 0;
+// Keeps the compiler from optimizing away the work that is measured
+static volatile uint32_t sink = 0;
+
+void *operator new(size_t size) {
+  allocations++;
+  if (void *ptr = malloc(size ? size : 1))
+    return ptr;
+  throw std::bad_alloc();
+}
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *ptr) noexcept { free(ptr); }
+void operator delete[](void *ptr) noexcept { free(ptr); }
+void operator delete(void *ptr, size_t /* size */) noexcept { free(ptr); }
+void operator delete[](void *ptr, size_t /* size */) noexcept { free(ptr); }
+
+struct Measurement {
+  double ns;
+  double allocations;
+};
+
+// Runs f repeatedly, doubling the number of runs until they take at least
+// MIN_TIME, and returns the time and allocations per run
+template<typename F> static Measurement measure(F &&f) {
+  for (size_t runs = 1;; runs *= 2) {
+    allocations = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < runs; i++)
+      f();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    if (elapsed >= MIN_TIME)
+      return {std::chrono::duration<double, std::nano>(elapsed).count() / runs, (double) allocations / runs};
+  }
+}
+
+static void report(const char *stage, const Measurement &m, size_t bytes) {
+  printf("  %-10s %12.0f %10.1f %16.2f\n", stage, m.ns, bytes / m.ns * 1000.0, m.allocations);
+}
+
+// Converts the present fields like Dsmr::publish_sensors() does, without
+// the sensors themselves
+struct Publisher {
+  template<typename Item> void apply(Item &item) {
+    if (item.present())
+      this->publish(item.val());
+  }
+  void publish(const dsmr::FixedValue &value) { this->total += value.val(); }
+  void publish(uint32_t value) { this->total += value; }
+  void publish(const dsmr::StringView &value) {
+    this->text.assign(value.data(), value.length());
+    this->total += this->text.length();
+  }
+
+  float total{0};
+  // Reserved up front, like the text buffer of the component
+  std::string text;
+};
+
+// A data line, split into its OBIS id and the rest
+struct Line {
+  const char *start;
+  const char *end;
+  dsmr::ParseResult<dsmr::ObisId> id;
+};
+
+template<typename Data> static void run_stages(const char *name, const std::string &telegram) {
+  const char *str = telegram.data();
+  const size_t n = telegram.size();
+  Data data;
+
+  // Check that the telegram parses at all, and split it into lines for
+  // the stages that look at single lines
+  dsmr::ParseResult<void> res = dsmr::P1Parser::parse(&data, str, n);
+  printf("%s, %zu bytes, %s\n", name, n, res.err ? reinterpret_cast<const char *>(res.err) : "ok");
+  printf("  %-10s %12s %10s %16s\n", "stage", "ns/telegram", "MB/s", "allocs/telegram");
+  dsmr::ParseResult<const char *> check = dsmr::P1Parser::check(str, n);
+  const char *data_end = check.err ? str + n : check.result;
+  const char *id_end = dsmr::P1Parser::find_line_end(str + 1, data_end);
+  std::vector<Line> lines;
+  for (const char *start = id_end + 1; start < data_end;) {
+    const char *end = dsmr::P1Parser::find_line_end(start, data_end);
+    if (end > start)
+      lines.push_back({start, end, dsmr::ObisIdParser::parse(start, end)});
+    start = end + 1;
+  }
+
+  report("crc", measure([&] { sink += dsmr::P1Parser::check(str, n).err == nullptr; }), n);
+  report("id_line", measure([&] {
+           data.reset();
+           sink += dsmr::P1Parser::parse_id_line(&data, str + 1, id_end).err == nullptr;
+         }),
+         id_end - str);
+  report("obis", measure([&] {
+           for (const Line &line : lines)
+             sink += dsmr::ObisIdParser::parse(line.start, line.end).err == nullptr;
+         }),
+         n);
+  report("lookup", measure([&] {
+           for (const Line &line : lines)
+             sink += Data::has_field(line.id.result);
+         }),
+         n);
+  report("fields", measure([&] {
+           data.reset();
+           for (const Line &line : lines) {
+             if (!line.id.err)
+               sink += data.parse_line(line.id.result, line.id.next, line.end).err == nullptr;
+           }
+         }),
+         n);
+  report("parse", measure([&] {
+           data.reset();
+           sink += dsmr::P1Parser::parse(&data, str, n).err == nullptr;
+         }),
+         n);
+
+  std::vector<char> buffer(n);
+  dsmr::P1StreamParser<Data> stream_parser(buffer.data(), buffer.size());
+  report("stream", measure([&] {
+           data.reset();
+           stream_parser.start(&data);
+           stream_parser.feed(str, n);
+           sink += stream_parser.result().err == nullptr;
+         }),
+         n);
+
+  data.reset();
+  dsmr::P1Parser::parse(&data, str, n);
+  Publisher publisher;
+  publisher.text.reserve(2048);
+  report("publish", measure([&] {
+           data.applyEach(publisher);
+           sink += publisher.total;
+         }),
+         n);
+}
+
+static bool read_file(const std::string &path, std::string &contents) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return true;
+}
+
+#ifdef DSMR_BENCH_DECRYPT
+// Key of telegrams/*.hex
+static const uint8_t DECRYPTION_KEY[] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+                                         0x88, 0x99, 0xAA, 0xBB, 0xCC, 0xDD, 0xEE, 0xFF};
+
+static std::string decode_hex(const std::string &hex) {
+  std::string bytes;
+  int high = -1;
+  for (char c : hex) {
+    if (!isxdigit((unsigned char) c))
+      continue;
+    const int nibble = isdigit((unsigned char) c) ? c - '0' : (toupper((unsigned char) c) - 'A' + 10);
+    if (high < 0) {
+      high = nibble;
+    } else {
+      bytes += (char) (high << 4 | nibble);
+      high = -1;
+    }
+  }
+  return bytes;
+}
+
+// Decrypts an encrypted frame into telegram, the same way as
+// Dsmr::decrypt_telegram_()
+static bool decrypt(esphome::dsmr_::Decryptor &decryptor, const std::string &frame, std::string &telegram) {
+  if (frame.size() < 18)
+    return false;
+  uint8_t iv[esphome::dsmr_::Decryptor::IV_SIZE];
+  memcpy(iv, &frame[2], 8);
+  memcpy(&iv[8], &frame[14], 4);
+  telegram.assign(frame, 18, std::string::npos);
+  if (!decryptor.decrypt(iv, reinterpret_cast<uint8_t *>(&telegram[0]), telegram.size()))
+    return false;
+  telegram.resize(strnlen(telegram.data(), telegram.size()));
+  return true;
+}
+#endif
+
+int main(int argc, char **argv) {
+  std::vector<std::string> paths(argv + 1, argv + argc);
+  if (paths.empty()) {
+    for (const auto &entry : std::filesystem::directory_iterator(DSMR_BENCH_TELEGRAMS))
+      paths.push_back(entry.path().string());
+    std::sort(paths.begin(), paths.end());
+  }
+
+  for (const std::string &path : paths) {
+    const std::string name = std::filesystem::path(path).filename().string();
+    std::string telegram;
+    if (!read_file(path, telegram)) {
+      fprintf(stderr, "%s: cannot read\n", path.c_str());
+      return 1;
+    }
+
+    // Encrypted frames are stored in hex
+    if (std::filesystem::path(path).extension() == ".hex") {
+#ifdef DSMR_BENCH_DECRYPT
+      const std::string frame = decode_hex(telegram);
+      esphome::dsmr_::Decryptor decryptor;
+      decryptor.set_key(DECRYPTION_KEY);
+      if (!decrypt(decryptor, frame, telegram)) {
+        fprintf(stderr, "%s: decryption failed\n", path.c_str());
+        return 1;
+      }
+      printf("%s, %zu bytes encrypted\n", name.c_str(), frame.size());
+      printf("  %-10s %12s %10s %16s\n", "stage", "ns/telegram", "MB/s", "allocs/telegram");
+      std::string buffer;
+      buffer.reserve(frame.size());
+      report("decrypt", measure([&] { sink += decrypt(decryptor, frame, buffer); }), frame.size());
+#else
+      printf("%s: skipped, built without OpenSSL for decryption\n\n", name.c_str());
+      continue;
+#endif
+    }
+
+    run_stages<AllFields>((name + ", all fields").c_str(), telegram);
+    run_stages<FewFields>((name + ", 5 fields").c_str(), telegram);
+    printf("\n");
+  }
+  return 0;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// Just enough of the Arduino core to build parser.h and fields.h on a host
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#define PROGMEM
+#define pgm_read_word(addr) (*(const uint16_t *) (addr))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+
+class String {
+ public:
+  String() = default;
+  String(const char *str) : str_(str) {}
+  String(const __FlashStringHelper *str) : str_(reinterpret_cast<const char *>(str)) {}
+
+  void reserve(unsigned int size) { this->str_.reserve(size); }
+  bool concat(const char *str) {
+    this->str_ += str;
+    return true;
+  }
+  String &operator+=(const char *str) {
+    this->str_ += str;
+    return *this;
+  }
+  String &operator+=(const __FlashStringHelper *str) { return *this += reinterpret_cast<const char *>(str); }
+  String &operator+=(char c) {
+    this->str_ += c;
+    return *this;
+  }
+
+  const char *c_str() const { return this->str_.c_str(); }
+  unsigned int length() const { return this->str_.length(); }
+
+ protected:
+  std::string str_;
+};
+
+class HardwareSerial {
+ public:
+  template<typename T> void print(const T & /* value */) {}
+  template<typename T> void println(const T & /* value */) {}
+};
+
+extern HardwareSerial Serial;
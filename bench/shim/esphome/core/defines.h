@@ -0,0 +1,4 @@
+#pragma once
+
+// Generated by ESPHome on a real build. The benchmark defines what it
+// needs on the compiler command line instead.
@@ -0,0 +1,44 @@
+#pragma once
+
+// The part of the mbedTLS GCM API that decryptor.cpp uses, on top of
+// OpenSSL, so the Decryptor can be benchmarked on a host that has no
+// mbedTLS. This measures OpenSSL rather than the ESP32 accelerator.
+
+#include <cstddef>
+#include <cstdint>
+
+#include <openssl/evp.h>
+
+#define MBEDTLS_GCM_DECRYPT 0
+#define MBEDTLS_CIPHER_ID_AES 2
+
+struct mbedtls_gcm_context {
+  EVP_CIPHER_CTX *ctx;
+};
+
+inline void mbedtls_gcm_init(mbedtls_gcm_context *gcm) { gcm->ctx = EVP_CIPHER_CTX_new(); }
+
+inline void mbedtls_gcm_free(mbedtls_gcm_context *gcm) {
+  EVP_CIPHER_CTX_free(gcm->ctx);
+  gcm->ctx = nullptr;
+}
+
+inline int mbedtls_gcm_setkey(mbedtls_gcm_context *gcm, int /* cipher */, const unsigned char *key,
+                              unsigned int keybits) {
+  if (keybits != 128)
+    return -1;
+  return EVP_DecryptInit_ex(gcm->ctx, EVP_aes_128_gcm(), nullptr, key, nullptr) == 1 ? 0 : -1;
+}
+
+// Only decrypts, the tag is not computed
+inline int mbedtls_gcm_crypt_and_tag(mbedtls_gcm_context *gcm, int mode, size_t length, const unsigned char *iv,
+                                     size_t iv_len, const unsigned char * /* add */, size_t /* add_len */,
+                                     const unsigned char *input, unsigned char *output, size_t /* tag_len */,
+                                     unsigned char * /* tag */) {
+  int len;
+  if (mode != MBEDTLS_GCM_DECRYPT || iv_len != 12)
+    return -1;
+  if (EVP_DecryptInit_ex(gcm->ctx, nullptr, nullptr, nullptr, iv) != 1)
+    return -1;
+  return EVP_DecryptUpdate(gcm->ctx, output, &len, input, (int) length) == 1 ? 0 : -1;
+}
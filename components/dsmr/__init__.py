@@ -3,19 +3,47 @@ import esphome.config_validation as cv
 from esphome.components import uart
 from esphome.const import (
     CONF_ID,
+    CONF_PLATFORM,
     CONF_UART_ID,
 )
+from esphome.core import CORE
 
 DEPENDENCIES = ["uart"]
 AUTO_LOAD = ["sensor", "text_sensor"]
+MULTI_CONF = True
 
 CONF_DSMR_ID = "dsmr_id"
 CONF_DECRYPTION_KEY = "decryption_key"
+CONF_HARDWARE_DECRYPTION = "hardware_decryption"
+CONF_PUBLISH_HEARTBEAT = "publish_heartbeat"
+CONF_MIN_PUBLISH_INTERVAL = "min_publish_interval"
+CONF_MAX_LOOP_TIME = "max_loop_time"
+CONF_DIAGNOSTICS_INTERVAL = "diagnostics_interval"
+CONF_MAX_TELEGRAM_LENGTH = "max_telegram_length"
+CONF_SKIP_UNUSED_LINES = "skip_unused_lines"
+CONF_RECEIVE_TASK = "receive_task"
 
 dsmr_ns = cg.esphome_ns.namespace("dsmr_")
 DSMR = dsmr_ns.class_("Dsmr", cg.Component, uart.UARTDevice)
 
 
+def configured_fields(domain, type_, exclude=()):
+    """Returns the fields used by all dsmr platforms of a domain, for all
+    meters. All meters share the parsed data type, so the list of fields
+    must be the same for each of them. Keys in exclude are not fields."""
+    fields = []
+    for platform in CORE.config.get(domain, []):
+        if platform.get(CONF_PLATFORM) != "dsmr":
+            continue
+        for key, conf in platform.items():
+            if not isinstance(conf, dict):
+                continue
+            id = conf.get(CONF_ID)
+            if id and id.type == type_ and key not in fields and key not in exclude:
+                fields.append(key)
+    return fields
+
+
 def _validate_key(value):
     value = cv.string_strict(value)
     parts = [value[i : i + 2] for i in range(0, len(value), 2)]
@@ -38,6 +66,26 @@ CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(): cv.declare_id(DSMR),
         cv.Optional(CONF_DECRYPTION_KEY): _validate_key,
+        cv.Optional(CONF_HARDWARE_DECRYPTION): cv.All(
+            cv.boolean, cv.only_on_esp32
+        ),
+        cv.Optional(
+            CONF_PUBLISH_HEARTBEAT, default="60s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(
+            CONF_MIN_PUBLISH_INTERVAL, default="0s"
+        ): cv.positive_time_period_milliseconds,
+        cv.Optional(
+            CONF_MAX_LOOP_TIME, default="0ms"
+        ): cv.positive_time_period_microseconds,
+        cv.Optional(
+            CONF_DIAGNOSTICS_INTERVAL, default="60s"
+        ): cv.positive_time_period_milliseconds,
+        # Defaults to room for a typical telegram plus the longest text
+        # sensor, see DEFAULT_TELEGRAM_LENGTH
+        cv.Optional(CONF_MAX_TELEGRAM_LENGTH): cv.int_range(min=64, max=65535),
+        cv.Optional(CONF_SKIP_UNUSED_LINES, default=False): cv.boolean,
+        cv.Optional(CONF_RECEIVE_TASK): cv.All(cv.boolean, cv.only_on_esp32),
     }
 ).extend(uart.UART_DEVICE_SCHEMA)
 
@@ -47,7 +95,20 @@ def to_code(config):
     var = cg.new_Pvariable(config[CONF_ID], uart_component)
     if CONF_DECRYPTION_KEY in config:
         cg.add(var.set_decryption_key(config[CONF_DECRYPTION_KEY]))
+    cg.add(var.set_publish_heartbeat(config[CONF_PUBLISH_HEARTBEAT]))
+    cg.add(var.set_min_publish_interval(config[CONF_MIN_PUBLISH_INTERVAL]))
+    cg.add(var.set_max_loop_time(config[CONF_MAX_LOOP_TIME]))
+    cg.add(var.set_diagnostics_interval(config[CONF_DIAGNOSTICS_INTERVAL]))
+    if CONF_MAX_TELEGRAM_LENGTH in config:
+        cg.add(var.set_max_telegram_length(config[CONF_MAX_TELEGRAM_LENGTH]))
+    cg.add(var.set_skip_unused_lines(config[CONF_SKIP_UNUSED_LINES]))
+    if config.get(CONF_RECEIVE_TASK, False):
+        cg.add(var.set_receive_task(True))
     yield cg.register_component(var, config)
 
-    # Crypto
-    cg.add_library("1168", "0.2.0")
+    if config.get(CONF_HARDWARE_DECRYPTION, False):
+        # mbedTLS uses the AES accelerator of the ESP32
+        cg.add_define("DSMR_USE_MBEDTLS")
+    else:
+        # Crypto
+        cg.add_library("1168", "0.2.0")
@@ -0,0 +1,127 @@
+/**
+ * Table driven CRC16 for DSMR telegrams.
+ *
+ * DSMR uses CRC16/ARC (polynomial 0x8005, reflected as 0xA001, initial
+ * value 0) over everything from the leading / up to and including the !.
+ * _crc16_update() from crc16.h computes this one bit at a time, which is
+ * slow for 1-2kB telegrams that arrive every second. This file offers the
+ * same CRC using a lookup table and, where memory allows, "slicing-by-N"
+ * lookup tables that process 4 or 8 bytes per step.
+ *
+ * The variant is chosen at compile time by DSMR_CRC16_SLICES:
+ *  - 0: bitwise, no tables (smallest)
+ *  - 1: one 256-entry table (512 bytes)
+ *  - 4: four tables (2kB)
+ *  - 8: eight tables (4kB), the default on the ESP32
+ *
+ * The tables are generated by the compiler. By default they are plain
+ * constant data, which ends up in RAM on the ESP8266 and in (cached)
+ * flash on the ESP32. Define DSMR_CRC16_TABLE_PROGMEM to move them to
+ * flash on the ESP8266, or DSMR_CRC16_TABLE_DRAM to move them to internal
+ * RAM on the ESP32, which avoids flash cache misses.
+ */
+
+#ifndef DSMR_INCLUDE_CRC_H
+#define DSMR_INCLUDE_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "crc16.h"
+#include "util.h"
+
+#ifndef DSMR_CRC16_SLICES
+#if defined(USE_ESP32) || defined(ARDUINO_ARCH_ESP32)
+#define DSMR_CRC16_SLICES 8
+#else
+#define DSMR_CRC16_SLICES 1
+#endif
+#endif
+
+#if defined(DSMR_CRC16_TABLE_PROGMEM)
+#define DSMR_CRC16_TABLE_ATTR PROGMEM
+#define DSMR_CRC16_TABLE_READ(entry) pgm_read_word(&(entry))
+#elif defined(DSMR_CRC16_TABLE_DRAM)
+#include <esp_attr.h>
+#define DSMR_CRC16_TABLE_ATTR DRAM_ATTR
+#define DSMR_CRC16_TABLE_READ(entry) (entry)
+#else
+#define DSMR_CRC16_TABLE_ATTR
+#define DSMR_CRC16_TABLE_READ(entry) (entry)
+#endif
+
+namespace dsmr {
+
+static_assert(DSMR_CRC16_SLICES == 0 || DSMR_CRC16_SLICES == 1 || DSMR_CRC16_SLICES == 4 || DSMR_CRC16_SLICES == 8,
+              "DSMR_CRC16_SLICES must be 0, 1, 4 or 8");
+
+#if DSMR_CRC16_SLICES > 0
+/**
+ * Lookup tables for CRC16/ARC. t[0] is the classic byte-at-a-time table,
+ * t[k] holds the CRC of a byte followed by k zero bytes, which allows
+ * combining the lookups of k + 1 consecutive bytes.
+ */
+struct Crc16Table {
+  uint16_t t[DSMR_CRC16_SLICES][256];
+
+  constexpr Crc16Table() : t() {
+    for (unsigned i = 0; i < 256; ++i) {
+      uint16_t crc = i;
+      for (int bit = 0; bit < 8; ++bit)
+        crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : (crc >> 1);
+      t[0][i] = crc;
+    }
+    for (unsigned slice = 1; slice < DSMR_CRC16_SLICES; ++slice) {
+      for (unsigned i = 0; i < 256; ++i)
+        t[slice][i] = (t[slice - 1][i] >> 8) ^ t[0][t[slice - 1][i] & 0xff];
+    }
+  }
+};
+
+static constexpr Crc16Table CRC16_TABLE DSMR_CRC16_TABLE_ATTR{};
+
+#define DSMR_CRC16_LOOKUP(slice, index) DSMR_CRC16_TABLE_READ(CRC16_TABLE.t[slice][index])
+#endif
+
+/**
+ * Update crc with a single byte.
+ */
+static inline uint16_t crc16_update(uint16_t crc, uint8_t data) __attribute__((always_inline, unused));
+static inline uint16_t crc16_update(uint16_t crc, uint8_t data) {
+#if DSMR_CRC16_SLICES == 0
+  return _crc16_update(crc, data);
+#else
+  return (crc >> 8) ^ DSMR_CRC16_LOOKUP(0, (crc ^ data) & 0xff);
+#endif
+}
+
+/**
+ * Update crc with n bytes starting at str.
+ */
+static inline uint16_t crc16_update(uint16_t crc, const char *str, size_t n) __attribute__((unused));
+static inline uint16_t crc16_update(uint16_t crc, const char *str, size_t n) {
+  const uint8_t *p = reinterpret_cast<const uint8_t *>(str);
+#if DSMR_CRC16_SLICES >= 4
+  while (n >= DSMR_CRC16_SLICES) {
+    // The 16 bit CRC only overlaps the first two bytes of each block
+    uint32_t word = crc ^ (p[0] | (p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24));
+    crc = DSMR_CRC16_LOOKUP(DSMR_CRC16_SLICES - 1, word & 0xff) ^
+          DSMR_CRC16_LOOKUP(DSMR_CRC16_SLICES - 2, (word >> 8) & 0xff) ^
+          DSMR_CRC16_LOOKUP(DSMR_CRC16_SLICES - 3, (word >> 16) & 0xff) ^
+          DSMR_CRC16_LOOKUP(DSMR_CRC16_SLICES - 4, word >> 24);
+#if DSMR_CRC16_SLICES == 8
+    crc ^= DSMR_CRC16_LOOKUP(3, p[4]) ^ DSMR_CRC16_LOOKUP(2, p[5]) ^ DSMR_CRC16_LOOKUP(1, p[6]) ^
+           DSMR_CRC16_LOOKUP(0, p[7]);
+#endif
+    p += DSMR_CRC16_SLICES;
+    n -= DSMR_CRC16_SLICES;
+  }
+#endif
+  while (n--)
+    crc = crc16_update(crc, *p++);
+  return crc;
+}
+
+}  // namespace dsmr
+
+#endif  // DSMR_INCLUDE_CRC_H
@@ -0,0 +1,56 @@
+#include "decryptor.h"
+
+namespace esphome {
+namespace dsmr_ {
+
+#ifdef DSMR_USE_MBEDTLS
+
+Decryptor::Decryptor() { mbedtls_gcm_init(&this->gcm_); }
+
+Decryptor::~Decryptor() { mbedtls_gcm_free(&this->gcm_); }
+
+void Decryptor::set_key(const uint8_t *key) {
+  // Expands the key and precomputes the GHASH tables
+  this->has_key_ = mbedtls_gcm_setkey(&this->gcm_, MBEDTLS_CIPHER_ID_AES, key, KEY_SIZE * 8) == 0;
+}
+
+void Decryptor::clear_key() {
+  mbedtls_gcm_free(&this->gcm_);
+  mbedtls_gcm_init(&this->gcm_);
+  this->has_key_ = false;
+}
+
+bool Decryptor::decrypt(const uint8_t *iv, uint8_t *data, size_t len) {
+  // The authentication tag is not checked, the telegram CRC is
+  uint8_t tag[16];
+  return mbedtls_gcm_crypt_and_tag(&this->gcm_, MBEDTLS_GCM_DECRYPT, len, iv, IV_SIZE, nullptr, 0, data, data,
+                                   sizeof(tag), tag) == 0;
+}
+
+#else
+
+Decryptor::Decryptor() = default;
+
+Decryptor::~Decryptor() = default;
+
+void Decryptor::set_key(const uint8_t *key) {
+  // Expands the key, setIV() resets the rest of the state for every frame
+  this->has_key_ = this->gcm_.setKey(key, KEY_SIZE);
+}
+
+void Decryptor::clear_key() {
+  this->gcm_.clear();
+  this->has_key_ = false;
+}
+
+bool Decryptor::decrypt(const uint8_t *iv, uint8_t *data, size_t len) {
+  if (!this->gcm_.setIV(iv, IV_SIZE))
+    return false;
+  this->gcm_.decrypt(data, data, len);
+  return true;
+}
+
+#endif
+
+}  // namespace dsmr_
+}  // namespace esphome
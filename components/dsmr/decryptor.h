@@ -0,0 +1,49 @@
+#pragma once
+
+#include "esphome/core/defines.h"
+
+#include <cstddef>
+#include <cstdint>
+
+#ifdef DSMR_USE_MBEDTLS
+#include <mbedtls/gcm.h>
+#else
+#include <AES.h>
+#include <Crypto.h>
+#include <GCM.h>
+#endif
+
+namespace esphome {
+namespace dsmr_ {
+
+// AES-128-GCM decryption of encrypted telegrams. The cipher context is set
+// up once when the key is set, so each frame only needs a new IV.
+//
+// By default this uses the Crypto library. With DSMR_USE_MBEDTLS it uses
+// mbedTLS instead, which uses the AES hardware accelerator of the ESP32.
+class Decryptor {
+ public:
+  Decryptor();
+  ~Decryptor();
+
+  void set_key(const uint8_t *key);
+  void clear_key();
+  bool has_key() const { return this->has_key_; }
+
+  // Decrypt len bytes of data in place, using a 12 byte IV
+  bool decrypt(const uint8_t *iv, uint8_t *data, size_t len);
+
+  static constexpr size_t KEY_SIZE = 16;
+  static constexpr size_t IV_SIZE = 12;
+
+ protected:
+  bool has_key_{false};
+#ifdef DSMR_USE_MBEDTLS
+  mbedtls_gcm_context gcm_;
+#else
+  GCM<AES128> gcm_;
+#endif
+};
+
+}  // namespace dsmr_
+}  // namespace esphome
@@ -1,150 +1,529 @@
 #include "dsmr.h"
 #include "esphome/core/log.h"
 
-#include <AES.h>
-#include <Crypto.h>
-#include <GCM.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstring>
 
 namespace esphome {
 namespace dsmr_ {
 
 static const char *TAG = "dsmr";
 
+void Dsmr::setup() {
+  for (Frame &frame : this->frames_) {
+    frame.telegram = new char[this->max_telegram_length_];
+    this->free_frames_.push(&frame);
+  }
+  this->text_buffer_.reserve(MAX_TEXT_LENGTH);
+#define DSMR_ALLOCATE_HISTORY(s) \
+  if (this->history_##s##_) \
+    this->history_##s##_->allocate();
+  DSMR_SENSOR_LIST(DSMR_ALLOCATE_HISTORY, )
+  if (this->diagnostics_interval_ != 0)
+    this->set_interval("diagnostics", this->diagnostics_interval_, [this]() { this->publish_diagnostics_(); });
+#ifdef DSMR_HAS_RECEIVE_TASK
+  if (this->receive_task_) {
+    // The UART driver already receives in its interrupt handler, into the
+    // RX buffer. Sleep until that is about half full at the configured
+    // baud rate (10 bits per byte), so the task wakes up as little as
+    // possible without risking an overflow.
+    const uint32_t bytes_per_second = this->parent_->get_baud_rate() / 10;
+    if (bytes_per_second > 0) {
+      const uint32_t interval = this->parent_->get_rx_buffer_size() / 2 * 1000 / bytes_per_second;
+      this->receive_task_interval_ = std::max(RECEIVE_TASK_MIN_INTERVAL, std::min(interval, RECEIVE_TASK_MAX_INTERVAL));
+    }
+    ESP_LOGD(TAG, "Receive task reads the UART every %" PRIu32 " ms", this->receive_task_interval_);
+    // The main loop runs on the application core, so receive on the other one
+    xTaskCreatePinnedToCore(Dsmr::receive_task_fn_, "dsmr", RECEIVE_TASK_STACK_SIZE, this, RECEIVE_TASK_PRIORITY,
+                            &this->receive_task_handle_, RECEIVE_TASK_CORE);
+  }
+#endif
+}
+
 void Dsmr::loop() {
-  if (this->decryption_key_.size() == 0)
+  this->loop_start_ = micros();
+  if (this->unexpected_data_.load(std::memory_order_relaxed)) {
+    this->unexpected_data_.store(false, std::memory_order_relaxed);
+    this->status_momentary_warning("unexpected_data");
+  }
+
+  this->update_aggregates_();
+  this->handle_pending_();
+  if (this->receive_task_)
+    return;
+
+  this->receive_();
+  // Handle a telegram that was just received, as far as time allows
+  this->handle_pending_();
+}
+
+#ifdef DSMR_HAS_RECEIVE_TASK
+// Intervals shorter than a tick would round down to 0 ticks, which does
+// not let lower priority tasks run
+static TickType_t interval_ticks(uint32_t interval) { return std::max<TickType_t>(1, pdMS_TO_TICKS(interval)); }
+
+void Dsmr::receive_task_fn_(void *param) {
+  Dsmr *dsmr = static_cast<Dsmr *>(param);
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lock(dsmr->decryptor_lock_);
+      dsmr->receive_();
+    }
+    // Wait until the main loop hands back a frame, or for more data,
+    // unless the last call stopped halfway because of its budget
+    if (dsmr->receive_frame_ == nullptr)
+      ulTaskNotifyTake(pdTRUE, interval_ticks(RECEIVE_TASK_MAX_INTERVAL));
+    else if (!dsmr->available())
+      vTaskDelay(interval_ticks(dsmr->receive_task_interval_));
+  }
+}
+
+// Wakes up the receive task when it waits for a free frame
+void Dsmr::notify_receive_task_() {
+  if (this->receive_task_handle_ != nullptr)
+    xTaskNotifyGive(this->receive_task_handle_);
+}
+#endif
+
+// Receives data into receive_frame_. This runs in loop(), or in the
+// receive task, so it only shares frames with the main loop through the
+// queues.
+void Dsmr::receive_() {
+  // Receiving waits while all frames are still being handled
+  if (this->receive_frame_ == nullptr && !this->free_frames_.pop(this->receive_frame_))
+    return;
+
+  // Only the time spent on a telegram counts, from its header on, not
+  // polling an idle UART in between or telegrams that were abandoned
+  if (!this->header_found_)
+    this->receive_time_ = 0;
+  this->receive_start_ = micros();
+  if (!this->decryptor_.has_key())
     this->receive_telegram();
   else
     this->receive_encrypted();
+  // Receiving a telegram takes many calls, count them all until it is
+  // complete (or failed)
+  this->receive_time_ += micros() - this->receive_start_;
+}
+
+// Hands the telegram that was received into receive_frame_ over to the
+// main loop, with next as the first step of handling it, and continues
+// with the next free frame if any
+void Dsmr::frame_received_(Pending next) {
+  Frame *frame = this->receive_frame_;
+  const uint32_t now = micros();
+  frame->receive_time = this->receive_time_ + (now - this->receive_start_);
+  this->receive_time_ = 0;
+  this->receive_start_ = now;
+  frame->decrypted = false;
+  frame->parsed = false;
+  frame->next = next;
+  // The receive task decrypts and parses as well, so the main loop only
+  // has to publish
+  while (this->receive_task_ && (frame->next == Pending::DECRYPT || frame->next == Pending::PARSE))
+    frame->next = this->run_step_(*frame, frame->next);
+
+  this->ready_frames_.push(frame);
+  this->receive_frame_ = nullptr;
+  this->free_frames_.pop(this->receive_frame_);
+}
+
+// Decrypts or parses the telegram in frame, returns the next step
+Pending Dsmr::run_step_(Frame &frame, Pending step) {
+  const uint32_t start = micros();
+  if (step == Pending::DECRYPT) {
+    const bool ok = this->decrypt_telegram_(frame);
+    frame.decrypt_time = micros() - start;
+    frame.decrypted = true;
+    return ok ? Pending::PARSE : Pending::CHECK;
+  }
+  this->parse_telegram_(frame);
+  frame.parse_time = micros() - start;
+  frame.parsed = true;
+  return Pending::CHECK;
+}
+
+// Returns true when there is no more work left on the received telegrams
+bool Dsmr::handle_pending_() {
+  while (true) {
+    if (this->ready_frame_ == nullptr) {
+      if (!this->ready_frames_.pop(this->ready_frame_))
+        return true;
+      this->pending_ = this->ready_frame_->next;
+      this->publish_all_ = this->ready_frame_->publish_all;
+    }
+    if (this->loop_time_exceeded_())
+      return false;
+    const uint32_t start = micros();
+    switch (this->pending_) {
+      case Pending::DECRYPT:
+      case Pending::PARSE:
+        this->pending_ = this->run_step_(*this->ready_frame_, this->pending_);
+        break;
+      case Pending::CHECK:
+        if (this->handle_result_(*this->ready_frame_)) {
+          this->add_history_(this->ready_frame_->data);
+          this->pending_ = Pending::PUBLISH;
+        } else {
+          this->pending_ = Pending::NONE;
+        }
+        break;
+      case Pending::PUBLISH: {
+        const bool done = this->publish_sensors(this->ready_frame_->data);
+        this->publish_time_ += micros() - start;
+        if (!done)
+          return false;
+        this->publish_time_stat_.add(this->publish_time_);
+        this->publish_time_ = 0;
+        this->pending_ = Pending::NONE;
+        break;
+      }
+      default:
+        break;
+    }
+    if (this->pending_ == Pending::NONE) {
+      this->free_frames_.push(this->ready_frame_);
+      this->ready_frame_ = nullptr;
+#ifdef DSMR_HAS_RECEIVE_TASK
+      this->notify_receive_task_();
+#endif
+    }
+  }
+}
+
+bool Dsmr::loop_time_exceeded_() const {
+  return this->max_loop_time_ != 0 && micros() - this->loop_start_ >= this->max_loop_time_;
+}
+
+// Only loop() has a time limit, the receive task does not
+bool Dsmr::receive_time_exceeded_() const { return !this->receive_task_ && this->loop_time_exceeded_(); }
+
+// Returns true when publishing should continue with the given sensor in
+// the next loop() call. At least one sensor is published per call.
+bool Dsmr::yield_publish_(size_t index) {
+  if (index == this->publish_index_ || !this->loop_time_exceeded_())
+    return false;
+  this->publish_index_ = index;
+  return true;
 }
 
 void Dsmr::receive_telegram() {
-  while (available()) {
-    const char c = read();
+  size_t budget = RECEIVE_BUDGET;
+  while (true) {
+    // Read from the UART in chunks, instead of calling read() for every byte
+    if (chunk_pos_ == chunk_len_) {
+      const size_t avail = available();
+      if (avail == 0 || budget == 0)
+        return;
+      chunk_len_ = std::min({avail, sizeof(chunk_), budget});
+      budget -= chunk_len_;
+      chunk_pos_ = 0;
+      if (!read_array(chunk_, chunk_len_)) {
+        chunk_len_ = 0;
+        return;
+      }
+    }
 
-    if (c == '/') {  // header: forward slash
+    const char *data = reinterpret_cast<const char *>(&chunk_[chunk_pos_]);
+    size_t n = chunk_len_ - chunk_pos_;
+
+    if (*data == '/') {  // header: forward slash
       ESP_LOGV(TAG, "Header found");
-      header_found_ = true;
-      footer_found_ = false;
-      telegram_len_ = 0;
+      // Skipped telegrams are ignored up to the next header
+      header_found_ = this->start_telegram_();
+      if (header_found_) {
+        receive_frame_->data.reset();
+        stream_parser_.set_buffer(receive_frame_->telegram, max_telegram_length_);
+        stream_parser_.start(&receive_frame_->data);
+      }
     }
 
-    if (!header_found_)
+    // Stop at the next header, which starts a new telegram
+    const char *next = static_cast<const char *>(memchr(data + 1, '/', n - 1));
+    if (next != nullptr)
+      n = next - data;
+
+    if (!header_found_) {
+      chunk_pos_ += n;
       continue;
-    if (telegram_len_ >= MAX_TELEGRAM_LENGTH) {  // Buffer overflow
+    }
+
+    // The checksum is updated while the telegram comes in, and the lines
+    // are only parsed once it matches. Any data after the checksum stays
+    // in chunk_ for the next call.
+    chunk_pos_ += stream_parser_.feed(data, n);
+    if (stream_parser_.done()) {
+      ESP_LOGV(TAG, "Checksum received");
       header_found_ = false;
-      footer_found_ = false;
-      ESP_LOGE(TAG, "Error: Message larger than buffer");
-    }
-
-    telegram_[telegram_len_] = c;
-    telegram_len_++;
-    if (c == '!') {  // footer: exclamation mark
-      ESP_LOGV(TAG, "Footer found");
-      footer_found_ = true;
-    } else {
-      if (footer_found_ && c == 10) {  // last \n after footer
-        header_found_ = false;
-        // Parse message
-        if (parse_telegram())
-          return;
-      }
+      receive_frame_->length = stream_parser_.length();
+      receive_frame_->result = stream_parser_.result();
+      receive_frame_->checksum = stream_parser_.checksum();
+      this->frame_received_(Pending::CHECK);
+      return;
     }
+
+    if (this->receive_time_exceeded_())
+      return;
   }
 }
 
 void Dsmr::receive_encrypted() {
-  // Encrypted buffer
-  uint8_t buffer[MAX_TELEGRAM_LENGTH];
-  size_t buffer_length = 0;
+  const uint32_t now = millis();
+
+  // Frames are received over several loop() calls. When the meter stops
+  // sending halfway through a frame, drop it so the next one can start.
+  if (header_found_ && !available() && now - last_read_time_ > POLL_TIMEOUT) {
+    ESP_LOGW(TAG, "Timeout while waiting for encrypted data or invalid data received.");
+    header_found_ = false;
+  }
 
-  size_t packet_size = 0;
-  while (available()) {
-    const char c = read();
+  uint8_t *buffer = reinterpret_cast<uint8_t *>(this->receive_frame_->telegram);
+  int &telegram_len = this->receive_frame_->length;
+  size_t budget = RECEIVE_BUDGET;
+  size_t avail;
+  while (budget > 0 && (avail = available()) > 0) {
+    last_read_time_ = now;
 
     if (!header_found_) {
-      if (c == 0xdb) {
-        ESP_LOGV(TAG, "Start byte 0xDB found");
-        header_found_ = true;
-      }
+      header_found_ = true;
+      telegram_len = 0;
+      packet_size_ = 0;
     }
 
-    // Sanity check
-    if (!header_found_ || buffer_length >= MAX_TELEGRAM_LENGTH) {
-      if (buffer_length == 0) {
-        ESP_LOGE(TAG, "First byte of encrypted telegram should be 0xDB, aborting.");
-      } else {
-        ESP_LOGW(TAG, "Unexpected data");
-      }
-      this->status_momentary_warning("unexpected_data");
-      this->flush();
-      while (available())
-        read();
+    // Read directly into the frame buffer, up to the end of the header
+    // (and a few bytes of data) first, then up to the end of the frame
+    const size_t want = (packet_size_ > 0 ? packet_size_ + 13 : 21) - telegram_len;
+    // Never write past the buffer, whatever the header says
+    const size_t room = max_telegram_length_ - telegram_len;
+    const size_t n = std::min({avail, want, budget, room});
+    if (n == 0) {
+      ESP_LOGE(TAG, "Encrypted telegram does not fit in buffer, aborting.");
+      this->abort_encrypted_();
       return;
     }
+    if (!read_array(&buffer[telegram_len], n))
+      return;
+    budget -= n;
 
-    buffer[buffer_length++] = c;
+    if (telegram_len == 0) {
+      if (buffer[0] != 0xdb) {
+        ESP_LOGE(TAG, "First byte of encrypted telegram should be 0xDB, aborting.");
+        this->abort_encrypted_();
+        return;
+      }
+      ESP_LOGV(TAG, "Start byte 0xDB found");
+    }
+    telegram_len += n;
 
-    if (packet_size == 0 && buffer_length > 20)  // Complete header + a few bytes of data
-    {
-      packet_size = buffer[11] << 8 | buffer[12];
-    }
-    if (buffer_length == packet_size + 13 && packet_size > 0) {
-      ESP_LOGV(TAG, "Encrypted data: %d bytes", buffer_length);
-
-      GCM<AES128> *gcmaes128{new GCM<AES128>()};
-      gcmaes128->setKey(this->decryption_key_.data(), gcmaes128->keySize());
-      // the iv is 8 bytes of the system title + 4 bytes frame counter
-      // system title is at byte 2 and frame counter at byte 15
-      for (int i = 10; i < 14; i++)
-        buffer[i] = buffer[i + 4];
-      constexpr uint16_t iv_size{12};
-      gcmaes128->setIV(&buffer[2], iv_size);
-      gcmaes128->decrypt(static_cast<uint8_t *>(static_cast<void *>(this->telegram_)),
-                         // the cypher text start at byte 18
-                         &buffer[18],
-                         // cypher data size
-                         buffer_length - 17);
-      delete gcmaes128;
-
-      telegram_len_ = strlen(this->telegram_);
-      ESP_LOGV(TAG, "Decrypted data length: %d", telegram_len_);
-      ESP_LOGVV(TAG, "Decrypted data %s", this->telegram_);
-
-      parse_telegram();
-      telegram_len_ = 0;
+    if (packet_size_ == 0 && telegram_len > 20) {  // Complete header + a few bytes of data
+      packet_size_ = buffer[11] << 8 | buffer[12];
+      // The frame continues at least up to the bytes read so far, a
+      // shorter length means a corrupted header
+      if (packet_size_ + 13 < 21) {
+        ESP_LOGE(TAG, "Invalid encrypted telegram length %d, aborting.", packet_size_);
+        this->abort_encrypted_();
+        return;
+      }
+      if (packet_size_ + 13 > max_telegram_length_) {
+        ESP_LOGE(TAG, "Encrypted telegram of %d bytes is larger than buffer", packet_size_ + 13);
+        this->abort_encrypted_();
+        // Hand it over anyway, so it is counted
+        telegram_len = 0;
+        this->receive_frame_->result = ::dsmr::ParseResult<void>().fail(
+            (const __FlashStringHelper *) ::dsmr::BUFFER_OVERFLOW);
+        this->frame_received_(Pending::CHECK);
+        return;
+      }
+    }
+    if (packet_size_ > 0 && telegram_len == packet_size_ + 13) {
+      header_found_ = false;
+      if (this->start_telegram_())
+        this->frame_received_(Pending::DECRYPT);
       return;
     }
 
-    if (!available()) {
-      // baud rate is 115200 for encrypted data, this means a few byte should arrive every time
-      // program runs faster than buffer loading then available() might return false in the middle
-      delay(4);  // Wait for data
-    }
+    if (this->receive_time_exceeded_())
+      return;
   }
-  if (buffer_length > 0)
-    ESP_LOGW(TAG, "Timeout while waiting for encrypted data or invalid data received.");
 }
 
-bool Dsmr::parse_telegram() {
-  MyData data;
+void Dsmr::abort_encrypted_() {
+  header_found_ = false;
+  // Reported by loop(), this may run in the receive task
+  this->unexpected_data_.store(true, std::memory_order_relaxed);
+  this->flush();
+  while (available())
+    read();
+}
+
+bool Dsmr::decrypt_telegram_(Frame &frame) {
+  uint8_t *buffer = reinterpret_cast<uint8_t *>(frame.telegram);
+  ESP_LOGV(TAG, "Encrypted data: %d bytes", frame.length);
+
+  // the iv is 8 bytes of the system title + 4 bytes frame counter
+  // system title is at byte 2 and frame counter at byte 14
+  uint8_t iv[Decryptor::IV_SIZE];
+  memcpy(iv, &buffer[2], 8);
+  memcpy(&iv[8], &buffer[14], 4);
+
+  // the cypher text starts at byte 18. Move it to the start of the
+  // buffer, so it can be decrypted in place.
+  const size_t cypher_size = frame.length - 18;
+  memmove(buffer, &buffer[18], cypher_size);
+
+  if (!this->decryptor_.decrypt(iv, buffer, cypher_size)) {
+    frame.length = 0;
+    frame.result = ::dsmr::ParseResult<void>().fail((const __FlashStringHelper *) DECRYPTION_FAILED);
+    return false;
+  }
+
+  frame.length = strnlen(frame.telegram, cypher_size);
+  ESP_LOGV(TAG, "Decrypted data length: %d", frame.length);
+  ESP_LOGVV(TAG, "Decrypted data %.*s", frame.length, frame.telegram);
+  return true;
+}
+
+bool Dsmr::start_telegram_() {
+  const uint32_t now = millis();
+  bool &publish_all = this->receive_frame_->publish_all;
+  publish_all = !this->full_published_ || now - this->last_full_publish_ >= this->min_publish_interval_;
+  if (!publish_all && !this->has_priority_ && !this->has_history_) {
+    ESP_LOGVV(TAG, "Skipping telegram within minimum publish interval");
+    return false;
+  }
+  return true;
+}
+
+void Dsmr::parse_telegram_(Frame &frame) {
   ESP_LOGV(TAG, "Trying to parse");
-  ::dsmr::ParseResult<void> res =
-      ::dsmr::P1Parser::parse(&data, telegram_, telegram_len_,
-                              false);  // Parse telegram according to data definition. Ignore unknown values.
+  // Check the checksum first, so a corrupted telegram costs one pass over
+  // its bytes and leaves the parsed data alone
+  ::dsmr::ParseResult<const char *> check = ::dsmr::P1Parser::check(frame.telegram, frame.length);
+  if (check.err) {
+    frame.result = check;
+    if (check.err == (const __FlashStringHelper *) ::dsmr::CHECKSUM_MISMATCH) {
+      // The checksum covers everything from the leading / up to the checksum
+      frame.checksum = ::dsmr::crc16_update(0, frame.telegram, check.ctx - frame.telegram);
+    }
+    return;
+  }
+
+  frame.data.reset();
+  frame.result = ::dsmr::P1Parser::parse_data(&frame.data, frame.telegram + 1, check.result,
+                                              false);  // Parse telegram according to data definition. Ignore unknown values.
+  frame.result.next = check.next;
+}
+
+// Counts and reports the outcome of receiving, decrypting and parsing the
+// telegram in frame. Returns true when it can be published.
+bool Dsmr::handle_result_(const Frame &frame) {
+  this->receive_time_stat_.add(frame.receive_time);
+  if (frame.decrypted)
+    this->decrypt_time_stat_.add(frame.decrypt_time);
+  if (frame.parsed)
+    this->parse_time_stat_.add(frame.parse_time);
+  this->telegrams_++;
+  // Telegrams that were dropped before parsing have no length
+  if (frame.length > 0)
+    this->telegram_length_stat_.add(frame.length);
+
+  const ::dsmr::ParseResult<void> &res = frame.result;
   if (res.err) {
+    this->last_failed_telegram_.assign(frame.telegram, frame.length);
+    if (res.err == (const __FlashStringHelper *) ::dsmr::CHECKSUM_MISMATCH) {
+      this->crc_failures_++;
+      this->handle_crc_error_(frame);
+      return false;
+    }
+    if (res.err == (const __FlashStringHelper *) DECRYPTION_FAILED) {
+      ESP_LOGE(TAG, "Decryption failed");
+      this->decrypt_failures_++;
+      return false;
+    }
+    if (res.err == (const __FlashStringHelper *) ::dsmr::BUFFER_OVERFLOW)
+      this->buffer_overflows_++;
+    else
+      this->parse_failures_++;
+
     // Parsing error, show it
-    auto err_str = res.fullError(telegram_, telegram_ + telegram_len_);
+    auto err_str = res.fullError(frame.telegram, frame.telegram + frame.length);
     ESP_LOGE(TAG, "%s", err_str.c_str());
     return false;
-  } else {
-    this->status_clear_warning();
-    publish_sensors(data);
-    return true;
   }
+  this->status_clear_warning();
+  return true;
+}
+
+// Records a checksum mismatch, the context of the result points to the
+// received checksum
+void Dsmr::handle_crc_error_(const Frame &frame) {
+  ::dsmr::ParseResult<uint16_t> received =
+      ::dsmr::CrcParser::parse(frame.result.ctx, frame.telegram + frame.length);
+  this->crc_error_.received = received.err ? 0 : received.result;
+  this->crc_error_.calculated = frame.checksum;
+  this->crc_error_.count++;
+
+  const uint32_t now = millis();
+  if (this->crc_error_.logged && now - this->crc_error_.last_log < CRC_ERROR_LOG_INTERVAL)
+    return;
+  ESP_LOGW(TAG, "Checksum mismatch: received %04X, calculated %04X (%" PRIu32 " mismatches since last report)",
+           this->crc_error_.received, this->crc_error_.calculated, this->crc_error_.count);
+  this->crc_error_.count = 0;
+  this->crc_error_.last_log = now;
+  this->crc_error_.logged = true;
+}
+
+// Adds the fields of a telegram to their history and aggregates. This
+// includes telegrams of which only the priority sensors are published.
+void Dsmr::add_history_(const MyData &data) {
+  if (!this->has_history_)
+    return;
+  const uint32_t now = millis();
+#define DSMR_ADD_HISTORY(s) \
+  if (data.s##_present) { \
+    const int64_t value = raw_value(data.s); \
+    if (this->history_##s##_) \
+      this->history_##s##_->add(value); \
+    if (this->aggregate_##s##_) \
+      this->aggregate_##s##_->add(value, now, this->int_unit_##s##_ ? 1 : raw_scale(data.s)); \
+  }
+  DSMR_SENSOR_LIST(DSMR_ADD_HISTORY, )
+}
+
+// Publishes the aggregates of intervals that have ended, also when no
+// telegram came in since
+void Dsmr::update_aggregates_() {
+  if (!this->has_aggregate_)
+    return;
+  const uint32_t now = millis();
+#define DSMR_UPDATE_AGGREGATE(s) \
+  if (this->aggregate_##s##_) \
+    this->aggregate_##s##_->update(now);
+  DSMR_SENSOR_LIST(DSMR_UPDATE_AGGREGATE, )
+}
+
+void Dsmr::publish_diagnostics_() {
+#define DSMR_PUBLISH_COUNTER(c) \
+  if (this->c##_sensor_ != nullptr) \
+    this->c##_sensor_->publish_state(this->c##_);
+  DSMR_COUNTER_LIST(DSMR_PUBLISH_COUNTER)
+
+#define DSMR_PUBLISH_STATISTIC(s) \
+  if (this->s##_stat_.count > 0) { \
+    if (this->s##_sensor_ != nullptr) \
+      this->s##_sensor_->publish_state(this->s##_stat_.average()); \
+    if (this->s##_max_sensor_ != nullptr) \
+      this->s##_max_sensor_->publish_state(this->s##_stat_.max); \
+  } \
+  this->s##_stat_.reset();
+  DSMR_STATISTIC_LIST(DSMR_PUBLISH_STATISTIC)
 }
 
 void Dsmr::dump_config() {
   ESP_LOGCONFIG(TAG, "dsmr:");
+  ESP_LOGCONFIG(TAG, "  Max telegram length: %zu", this->max_telegram_length_);
 
 #define DSMR_LOG_SENSOR(s) LOG_SENSOR("  ", #s, this->s_##s##_);
   DSMR_SENSOR_LIST(DSMR_LOG_SENSOR, )
@@ -154,9 +533,13 @@ void Dsmr::dump_config() {
 }
 
 void Dsmr::set_decryption_key(const std::string &decryption_key) {
+#ifdef DSMR_HAS_RECEIVE_TASK
+  // The receive task uses the key while it holds the lock
+  std::lock_guard<std::mutex> lock(this->decryptor_lock_);
+#endif
   if (decryption_key.length() == 0) {
     ESP_LOGI(TAG, "Disabling decryption");
-    this->decryption_key_.clear();
+    this->decryptor_.clear_key();
     return;
   }
 
@@ -164,17 +547,19 @@ void Dsmr::set_decryption_key(const std::string &decryption_key) {
     ESP_LOGE(TAG, "Error, decryption key must be 32 character long.");
     return;
   }
-  this->decryption_key_.clear();
 
   ESP_LOGI(TAG, "Decryption key is set.");
   // Verbose level prints decryption key
   ESP_LOGV(TAG, "Using decryption key: %s", decryption_key.c_str());
 
+  uint8_t key[Decryptor::KEY_SIZE];
   char temp[3] = {0};
   for (int i = 0; i < 16; i++) {
     strncpy(temp, &(decryption_key.c_str()[i * 2]), 2);
-    decryption_key_.push_back(std::strtoul(temp, NULL, 16));
+    key[i] = std::strtoul(temp, NULL, 16);
   }
+  // Expand the key once, instead of for every telegram
+  this->decryptor_.set_key(key);
 }
 
 }  // namespace dsmr_
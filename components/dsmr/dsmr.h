@@ -7,14 +7,46 @@
 #include "esphome/core/log.h"
 #include "esphome/core/defines.h"
 
+#include "decryptor.h"
 #include "parser.h"
 #include "fields.h"
+#include "history.h"
+#include "spsc_queue.h"
+
+#include <atomic>
+#include <memory>
+
+#if defined(USE_ESP32) || defined(ARDUINO_ARCH_ESP32)
+#define DSMR_HAS_RECEIVE_TASK
+#include <mutex>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#endif
 
 namespace esphome {
 namespace dsmr_ {
 
-static constexpr uint32_t MAX_TELEGRAM_LENGTH = 1500;
-static constexpr uint32_t POLL_TIMEOUT = 1000;
+// Number of bytes read from the UART at once
+static constexpr size_t RECEIVE_CHUNK_SIZE = 64;
+// Maximum number of bytes read from the UART in one loop() call, so a
+// meter that sends a lot of data cannot starve other meters and
+// components. This is still well above what 115200 baud delivers between
+// two loop() calls.
+static constexpr size_t RECEIVE_BUDGET = 512;
+// Maximum time in ms between two bytes of an encrypted frame
+static constexpr uint32_t POLL_TIMEOUT = 200;
+
+#ifdef DSMR_HAS_RECEIVE_TASK
+// The receive task runs on the protocol core, next to WiFi and Bluetooth
+static constexpr BaseType_t RECEIVE_TASK_CORE = 0;
+static constexpr UBaseType_t RECEIVE_TASK_PRIORITY = 5;
+static constexpr uint32_t RECEIVE_TASK_STACK_SIZE = 8192;
+// Limits of the time in ms the receive task sleeps between reading the UART.
+// It always sleeps at least one tick, which is 10ms at the default tick
+// rate, or it would keep the idle task on its core from running.
+static constexpr uint32_t RECEIVE_TASK_MIN_INTERVAL = 1;
+static constexpr uint32_t RECEIVE_TASK_MAX_INTERVAL = 100;
+#endif
 
 using namespace dsmr::fields;
 
@@ -40,33 +72,274 @@ using namespace dsmr::fields;
 using MyData = dsmr::ParsedData<DSMR_TEXT_SENSOR_LIST(DSMR_DATA_SENSOR, COMMA)
                                     DSMR_BOTH DSMR_SENSOR_LIST(DSMR_DATA_SENSOR, COMMA)>;
 
+// Longest value of the given text fields, as far as known in advance
+template <typename... Ts> constexpr size_t max_text_length() {
+  size_t lengths[] = {0, Ts::max_length()...};
+  size_t max = 0;
+  for (size_t length : lengths)
+    max = length > max ? length : max;
+  return max;
+}
+
+static constexpr size_t MAX_TEXT_LENGTH = max_text_length<DSMR_TEXT_SENSOR_LIST(DSMR_DATA_SENSOR, COMMA)>();
+
+// Default size of the telegram buffer: room for a typical telegram, plus
+// the longest text field that is used (like a long message)
+static constexpr size_t DEFAULT_TELEGRAM_LENGTH = 1500 + MAX_TEXT_LENGTH;
+
+// Raw value of a numeric field, as parsed from the telegram
+inline uint64_t raw_value(const dsmr::FixedValue &value) { return value.int_val(); }
+inline uint64_t raw_value(uint32_t value) { return value; }
+
+// Value of a numeric field to publish, either in its normal unit or in its
+// integer unit (e.g. Wh instead of kWh)
+inline float publish_value(const dsmr::FixedValue &value, bool int_unit) {
+  return int_unit ? value.int_val() : value.val();
+}
+inline float publish_value(uint32_t value, bool /* int_unit */) { return value; }
+
+// Number of raw units per unit of the published value
+inline uint32_t raw_scale(const dsmr::FixedValue & /* value */) { return 1000; }
+inline uint32_t raw_scale(uint32_t /* value */) { return 1; }
+
+// Decides whether a numeric sensor should be published, based on how much
+// its raw value changed since it was last published
+struct PublishFilter {
+  void set_deadband(float absolute, float relative) {
+    this->enabled = true;
+    this->absolute = absolute + 0.5f;
+    this->relative = relative * 1000000.0f + 0.5f;
+  }
+
+  bool should_publish(uint64_t value, uint32_t now, uint32_t heartbeat) {
+    if (this->enabled && this->published && (heartbeat == 0 || now - this->last_publish < heartbeat)) {
+      uint64_t delta = value > this->last_value ? value - this->last_value : this->last_value - value;
+      if (delta <= this->threshold)
+        return false;
+    }
+    this->published = true;
+    this->last_value = value;
+    this->last_publish = now;
+    if (this->enabled) {
+      // relative * value / 1000000, without overflowing 64 bits
+      uint64_t relative = value / 1000000 * this->relative + value % 1000000 * this->relative / 1000000;
+      this->threshold = relative > this->absolute ? relative : this->absolute;
+    }
+    return true;
+  }
+
+  // Published for every telegram, also within the minimum publish interval
+  bool priority{false};
+
+  bool enabled{false};
+  // Changes up to these are not published. absolute is in raw units,
+  // relative in millionths of the last published value.
+  uint64_t absolute{0};
+  uint32_t relative{0};
+
+  bool published{false};
+  uint64_t last_value{0};
+  uint32_t last_publish{0};
+  // Largest change from last_value that is not published
+  uint64_t threshold{0};
+};
+
+// Count, average and maximum of a value (like the time a stage of handling
+// a telegram took) since the last reset
+struct Statistic {
+  void add(uint32_t value) {
+    this->count++;
+    this->total += value;
+    if (value > this->max)
+      this->max = value;
+  }
+  float average() const { return (float) this->total / this->count; }
+  void reset() { *this = Statistic(); }
+
+  uint32_t count{0};
+  uint64_t total{0};
+  uint32_t max{0};
+};
+
+// Steps of handling a received telegram: CHECK counts and reports the
+// outcome of the steps before it
+enum class Pending : uint8_t { NONE, DECRYPT, PARSE, CHECK, PUBLISH };
+
+static constexpr char DECRYPTION_FAILED[] DSMR_PROGMEM = "Decryption failed";
+
+// A telegram buffer, with the data parsed from it. Text fields of the data
+// point into the buffer. Frames are passed between the receiver and the
+// main loop, only one of them uses a frame at a time.
+struct Frame {
+  char *telegram{nullptr};
+  int length{0};
+  MyData data;
+  // Whether all sensors are published for this telegram, or only the
+  // priority sensors
+  bool publish_all{true};
+
+  // Next step of handling the telegram
+  Pending next{Pending::NONE};
+  // Outcome of receiving, decrypting and parsing the telegram
+  ::dsmr::ParseResult<void> result;
+  // Calculated checksum, for a checksum mismatch
+  uint16_t checksum{0};
+  // Time in us spent on each step, for the diagnostics
+  uint32_t receive_time{0};
+  uint32_t decrypt_time{0};
+  uint32_t parse_time{0};
+  bool decrypted{false};
+  bool parsed{false};
+};
+
+// Checksum mismatches are logged at most once per this many ms, since a
+// noisy line can cause a burst of them
+static constexpr uint32_t CRC_ERROR_LOG_INTERVAL = 10000;
+
+// The last checksum mismatch
+struct CrcError {
+  uint16_t received{0};
+  uint16_t calculated{0};
+  // Mismatches since the last one that was logged
+  uint32_t count{0};
+  uint32_t last_log{0};
+  bool logged{false};
+};
+
+// Diagnostic counters, which count since boot
+#define DSMR_COUNTER_LIST(F) F(telegrams) F(crc_failures) F(parse_failures) F(buffer_overflows) F(decrypt_failures)
+// Diagnostic statistics, which are published as an average and maximum
+// since the previous publish. Times are in us.
+#define DSMR_STATISTIC_LIST(F) F(receive_time) F(decrypt_time) F(parse_time) F(publish_time) F(telegram_length)
+
 class Dsmr : public Component, public uart::UARTDevice {
  public:
   Dsmr(uart::UARTComponent* uart) : uart::UARTDevice(uart) {}
 
+  void setup() override;
   void loop() override;
 
-  bool parse_telegram();
+  // Publishes the sensors, until max_loop_time is used up. Returns false
+  // when not all sensors were published yet, the next call continues with
+  // the next sensor.
+  bool publish_sensors(const MyData &data) {
+    const uint32_t now = millis();
+    if (this->publish_index_ == 0 && this->publish_all_) {
+      this->last_full_publish_ = now;
+      this->full_published_ = true;
+    }
+    size_t index = 0;
 
-  void publish_sensors(MyData data) {
 #define DSMR_PUBLISH_SENSOR(s) \
-  if (data.s##_present && this->s_##s##_ != nullptr) \
-    s_##s##_->publish_state(data.s);
+  if (index++ >= this->publish_index_ && data.s##_present && this->s_##s##_ != nullptr && \
+      (this->publish_all_ || this->filter_##s##_.priority)) { \
+    if (this->yield_publish_(index - 1)) \
+      return false; \
+    if (this->filter_##s##_.should_publish(raw_value(data.s), now, this->publish_heartbeat_)) \
+      s_##s##_->publish_state(publish_value(data.s, this->int_unit_##s##_)); \
+  }
     DSMR_SENSOR_LIST(DSMR_PUBLISH_SENSOR, )
 
 #define DSMR_PUBLISH_TEXT_SENSOR(s) \
-  if (data.s##_present && this->s_##s##_ != nullptr) \
-    s_##s##_->publish_state(data.s.c_str());
+  if (index++ >= this->publish_index_ && data.s##_present && this->s_##s##_ != nullptr && this->publish_all_) { \
+    if (this->yield_publish_(index - 1)) \
+      return false; \
+    this->text_buffer_.assign(data.s.data(), data.s.length()); \
+    s_##s##_->publish_state(this->text_buffer_); \
+  }
     DSMR_TEXT_SENSOR_LIST(DSMR_PUBLISH_TEXT_SENSOR, )
+
+    this->publish_index_ = 0;
+    return true;
   };
 
   void dump_config() override;
 
+  // The last checksum mismatch, and the last telegram that could not be
+  // parsed (for any reason), for inspection from a lambda
+  const CrcError &get_crc_error() const { return crc_error_; }
+  const std::string &get_last_failed_telegram() const { return last_failed_telegram_; }
+
+  // The last readings of a numeric field with a history, e.g.
+  // get_power_delivered_history().max()
+#define DSMR_GET_HISTORY(s) \
+  const History &get_##s##_history() const { return history_##s##_ ? *history_##s##_ : empty_history(); }
+  DSMR_SENSOR_LIST(DSMR_GET_HISTORY, )
+
   void set_decryption_key(const std::string& decryption_key);
 
+  // Size of the telegram buffer, which is allocated in setup()
+  void set_max_telegram_length(size_t max_telegram_length) { max_telegram_length_ = max_telegram_length; }
+
+  // Do not keep lines that are not used in the telegram buffer
+  void set_skip_unused_lines(bool skip_unused_lines) { stream_parser_.skip_unused = skip_unused_lines; }
+
+  // Sensors with a deadband are republished after this many ms, even when unchanged
+  void set_publish_heartbeat(uint32_t publish_heartbeat) { publish_heartbeat_ = publish_heartbeat; }
+
+  // Telegrams received within this many ms of the last full publish are
+  // skipped, or only used for the priority sensors
+  void set_min_publish_interval(uint32_t min_publish_interval) { min_publish_interval_ = min_publish_interval; }
+
+  // Interval in ms of publishing the diagnostic sensors
+  void set_diagnostics_interval(uint32_t diagnostics_interval) { diagnostics_interval_ = diagnostics_interval; }
+
+#define DSMR_SET_COUNTER(c) \
+  void set_##c##_sensor(sensor::Sensor *sensor) { c##_sensor_ = sensor; }
+  DSMR_COUNTER_LIST(DSMR_SET_COUNTER)
+
+#define DSMR_SET_STATISTIC(s) \
+  void set_##s##_sensor(sensor::Sensor *sensor) { s##_sensor_ = sensor; } \
+  void set_##s##_max_sensor(sensor::Sensor *sensor) { s##_max_sensor_ = sensor; }
+  DSMR_STATISTIC_LIST(DSMR_SET_STATISTIC)
+
+  // Time in us a loop() call may take before the remaining work is
+  // continued in the next call, 0 for no limit
+  void set_max_loop_time(uint32_t max_loop_time) { max_loop_time_ = max_loop_time; }
+
+#ifdef DSMR_HAS_RECEIVE_TASK
+  // Receive, decrypt and parse telegrams in a separate task, which leaves
+  // only publishing to loop()
+  void set_receive_task(bool receive_task) { receive_task_ = receive_task; }
+#endif
+
 // Sensor setters
 #define DSMR_SET_SENSOR(s) \
-  void set_##s(sensor::Sensor* sensor) { s_##s##_ = sensor; }
+  void set_##s(sensor::Sensor* sensor) { s_##s##_ = sensor; } \
+  void set_##s##_deadband(float absolute, float relative) { \
+    filter_##s##_.set_deadband(absolute * (int_unit_##s##_ ? 1 : raw_scale(frames_[0].data.s)), relative); \
+  } \
+  void set_##s##_priority(bool priority) { \
+    filter_##s##_.priority = priority; \
+    has_priority_ |= priority; \
+  } \
+  void set_##s##_int_unit(bool int_unit) { \
+    int_unit_##s##_ = int_unit; \
+    if (int_unit && s_##s##_ != nullptr) { \
+      s_##s##_->set_unit_of_measurement(s::int_unit()); \
+      s_##s##_->set_accuracy_decimals(0); \
+    } \
+    if (int_unit && aggregate_##s##_) \
+      aggregate_##s##_->set_int_unit(s::int_unit()); \
+  } \
+  void set_##s##_history_length(size_t length) { \
+    if (length == 0) \
+      return; \
+    history_##s##_.reset(new History()); \
+    history_##s##_->set_capacity(length); \
+    has_history_ = true; \
+  } \
+  void set_##s##_aggregate(uint32_t interval, sensor::Sensor *min, sensor::Sensor *max, sensor::Sensor *mean, \
+                           sensor::Sensor *delta) { \
+    aggregate_##s##_.reset(new Aggregate()); \
+    aggregate_##s##_->interval = interval; \
+    aggregate_##s##_->min_sensor = min; \
+    aggregate_##s##_->max_sensor = max; \
+    aggregate_##s##_->mean_sensor = mean; \
+    aggregate_##s##_->delta_sensor = delta; \
+    has_history_ = true; \
+    has_aggregate_ = true; \
+  }
   DSMR_SENSOR_LIST(DSMR_SET_SENSOR, )
 
 #define DSMR_SET_TEXT_SENSOR(s) \
@@ -74,25 +347,135 @@ class Dsmr : public Component, public uart::UARTDevice {
   DSMR_TEXT_SENSOR_LIST(DSMR_SET_TEXT_SENSOR, )
 
  protected:
+#ifdef DSMR_HAS_RECEIVE_TASK
+  static void receive_task_fn_(void *param);
+  void notify_receive_task_();
+#endif
+  void receive_();
   void receive_telegram();
   void receive_encrypted();
+  void abort_encrypted_();
+  bool start_telegram_();
+  void frame_received_(Pending next);
+  Pending run_step_(Frame &frame, Pending step);
+  bool decrypt_telegram_(Frame &frame);
+  void parse_telegram_(Frame &frame);
+  bool handle_pending_();
+  void publish_diagnostics_();
+  bool loop_time_exceeded_() const;
+  bool receive_time_exceeded_() const;
+  bool yield_publish_(size_t index);
+
+  bool handle_result_(const Frame &frame);
+  void add_history_(const MyData &data);
+  void update_aggregates_();
+  void handle_crc_error_(const Frame &frame);
 
-  // Telegram buffer
-  char telegram_[MAX_TELEGRAM_LENGTH];
-  int telegram_len_{0};
+  // Telegram buffers: the next telegram is received into one while the
+  // previous one is handled from the other, so receiving does not have to
+  // wait for parsing and publishing. They are allocated in setup().
+  Frame frames_[2];
+  // Frames go from the receiver to the main loop through ready_frames_,
+  // and back through free_frames_. Both are lock-free, since the receiver
+  // may run in its own task.
+  SpscQueue<Frame *, 2> ready_frames_;
+  SpscQueue<Frame *, 2> free_frames_;
+  // Frame being received into, and frame being handled, if any
+  Frame *receive_frame_{nullptr};
+  Frame *ready_frame_{nullptr};
+  size_t max_telegram_length_{DEFAULT_TELEGRAM_LENGTH};
 
   // Serial parser
   bool header_found_{false};
-  bool footer_found_{false};
 
-// Sensor member pointers
-#define DSMR_DECLARE_SENSOR(s) sensor::Sensor* s_##s##_{nullptr};
+  // Data read from the UART, chunk_[chunk_pos_, chunk_len_) is not handled yet
+  uint8_t chunk_[RECEIVE_CHUNK_SIZE];
+  size_t chunk_pos_{0};
+  size_t chunk_len_{0};
+
+  // Encrypted frames are received into receive_frame_ and decrypted in place
+  int packet_size_{0};
+  uint32_t last_read_time_{0};
+
+  ::dsmr::P1StreamParser<MyData> stream_parser_{nullptr, 0};
+
+// Sensor member pointers. History and aggregate are only allocated when
+// configured, as most sensors have neither.
+#define DSMR_DECLARE_SENSOR(s) \
+  sensor::Sensor* s_##s##_{nullptr}; \
+  PublishFilter filter_##s##_; \
+  bool int_unit_##s##_{false}; \
+  std::unique_ptr<History> history_##s##_; \
+  std::unique_ptr<Aggregate> aggregate_##s##_;
   DSMR_SENSOR_LIST(DSMR_DECLARE_SENSOR, )
 
 #define DSMR_DECLARE_TEXT_SENSOR(s) text_sensor::TextSensor* s_##s##_{nullptr};
   DSMR_TEXT_SENSOR_LIST(DSMR_DECLARE_TEXT_SENSOR, )
 
-  std::vector<uint8_t> decryption_key_{};
+  uint32_t publish_heartbeat_{0};
+
+  // Work on the telegram in ready_frame_ that is left for the next loop()
+  // calls
+  Pending pending_{Pending::NONE};
+  // Sensor to continue publishing with
+  size_t publish_index_{0};
+  uint32_t max_loop_time_{0};
+  uint32_t loop_start_{0};
+
+  // The receiver reads these to skip telegrams early. A stale value only
+  // means a telegram is parsed or skipped needlessly, so they are not
+  // synchronized with the receive task.
+  uint32_t min_publish_interval_{0};
+  uint32_t last_full_publish_{0};
+  bool full_published_{false};
+  // Whether any sensor is a priority sensor
+  bool has_priority_{false};
+  // Whether any field keeps a history or is aggregated, which needs every
+  // telegram
+  bool has_history_{false};
+  // Whether any field is aggregated, which is published from loop()
+  bool has_aggregate_{false};
+  // Whether all sensors are published for the telegram that is handled,
+  // or only the priority sensors
+  bool publish_all_{true};
+
+  // Diagnostics
+  uint32_t diagnostics_interval_{0};
+  // Time spent on the current telegram so far, per stage
+  uint32_t receive_time_{0};
+  uint32_t receive_start_{0};
+  uint32_t publish_time_{0};
+#define DSMR_DECLARE_COUNTER(c) \
+  uint32_t c##_{0}; \
+  sensor::Sensor *c##_sensor_{nullptr};
+  DSMR_COUNTER_LIST(DSMR_DECLARE_COUNTER)
+#define DSMR_DECLARE_STATISTIC(s) \
+  Statistic s##_stat_; \
+  sensor::Sensor *s##_sensor_{nullptr}; \
+  sensor::Sensor *s##_max_sensor_{nullptr};
+  DSMR_STATISTIC_LIST(DSMR_DECLARE_STATISTIC)
+
+  CrcError crc_error_;
+  // Only allocated once a telegram fails
+  std::string last_failed_telegram_;
+
+  // Text sensor values are copied here for publishing. It is reserved once
+  // and reused, so publishing does not allocate once it is large enough.
+  std::string text_buffer_;
+
+  Decryptor decryptor_;
+
+  bool receive_task_{false};
+  // Set by the receiver on unexpected data, reported by loop()
+  std::atomic<bool> unexpected_data_{false};
+#ifdef DSMR_HAS_RECEIVE_TASK
+  // Time in ms the receive task sleeps when there is no data
+  uint32_t receive_task_interval_{RECEIVE_TASK_MAX_INTERVAL};
+  // Notified when a frame is handed back to the receive task
+  TaskHandle_t receive_task_handle_{nullptr};
+  // Held by the receive task while it receives and decrypts
+  std::mutex decryptor_lock_;
+#endif
 };
 }  // namespace dsmr_
 }  // namespace esphome
@@ -47,16 +47,23 @@ struct ParsedField {
   }
   // By defaults, fields have no unit
   static const char *unit() { return ""; }
+  // The unit of int_val(), for fields that have one
+  static const char *int_unit() { return T::unit(); }
+  // Values are overwritten when parsed, so only clear the present flag
+  void reset() { static_cast<T*>(this)->present() = false; }
 };
 
 template <typename T, size_t minlen, size_t maxlen>
 struct StringField : ParsedField<T> {
   ParseResult<void> parse(const char *str, const char *end) {
-    ParseResult<String> res = StringParser::parse_string(minlen, maxlen, str, end);
+    ParseResult<StringView> res = StringParser::parse_string(minlen, maxlen, str, end);
     if (!res.err)
       static_cast<T*>(this)->val() = res.result;
     return res;
   }
+
+  // Maximum length of the value
+  static constexpr size_t max_length() { return maxlen; }
 };
 
 // A timestamp is essentially a string using YYMMDDhhmmssX format (where
@@ -72,13 +79,15 @@ struct TimestampField : StringField<T, 13, 13> { };
 // integer (by multiplying by 1000). Supports val() (or implicit cast to
 // float) to get the original value, and int_val() to get the more
 // efficient integer value. The unit() and int_unit() methods on
-// FixedField return the corresponding units for these values.
+// FixedField return the corresponding units for these values. The
+// integer is 64 bits, since cumulative registers like energy in Wh can
+// exceed 32 bits on large installations.
 struct FixedValue {
-  operator float() { return val();}
-  float val() { return _value / 1000.0;}
-  uint32_t int_val() { return _value; }
+  operator float() const { return val();}
+  float val() const { return _value / 1000.0f;}
+  uint64_t int_val() const { return _value; }
 
-  uint32_t _value;
+  uint64_t _value;
 };
 
 // Floating point numbers in the message never have more than 3 decimal
@@ -91,7 +100,7 @@ struct FixedValue {
 template <typename T, const char *_unit, const char *_int_unit>
 struct FixedField : ParsedField<T> {
   ParseResult<void> parse(const char *str, const char *end) {
-    ParseResult<uint32_t> res = NumParser::parse(3, _unit, str, end);
+    ParseResult<uint64_t> res = NumParser::parse<uint64_t>(3, _unit, str, end);
     if (!res.err)
       static_cast<T*>(this)->val()._value = res.result;
     return res;
@@ -102,7 +111,7 @@ struct FixedField : ParsedField<T> {
 };
 
 struct TimestampedFixedValue : public FixedValue {
-  String timestamp;
+  StringView timestamp;
 };
 
 // Some numerical values are prefixed with a timestamp. This is simply
@@ -111,7 +120,7 @@ template <typename T, const char *_unit, const char *_int_unit>
 struct TimestampedFixedField : public FixedField<T, _unit, _int_unit> {
   ParseResult<void> parse(const char *str, const char *end) {
     // First, parse timestamp
-    ParseResult<String> res = StringParser::parse_string(13, 13, str, end);
+    ParseResult<StringView> res = StringParser::parse_string(13, 13, str, end);
     if (res.err)
       return res;
 
@@ -122,11 +131,12 @@ struct TimestampedFixedField : public FixedField<T, _unit, _int_unit> {
   }
 };
 
-// A integer number is just represented as an integer.
+// A integer number is just represented as an integer. Numbers that do
+// not fit in the type of the field are an error.
 template <typename T, const char *_unit>
 struct IntField : ParsedField<T> {
   ParseResult<void> parse(const char *str, const char *end) {
-    ParseResult<uint32_t> res = NumParser::parse(0, _unit, str, end);
+    ParseResult<typename T::value_type> res = NumParser::parse<typename T::value_type>(0, _unit, str, end);
     if (!res.err)
       static_cast<T*>(this)->val() = res.result;
     return res;
@@ -140,10 +150,13 @@ struct IntField : ParsedField<T> {
 template <typename T>
 struct RawField : ParsedField<T> {
   ParseResult<void> parse(const char *str, const char *end) {
-    // Just copy the string verbatim value without any parsing
-    concat_hack(static_cast<T*>(this)->val(), str, end - str);
+    // Just refer to the string verbatim value without any parsing
+    static_cast<T*>(this)->val() = StringView(str, end - str);
     return ParseResult<void>().until(end);
   }
+
+  // The length is not limited, so no maximum is known in advance
+  static constexpr size_t max_length() { return 0; }
 };
 
 namespace fields {
@@ -170,7 +183,9 @@ struct units {
   static constexpr char GJ[] = "GJ";
   static constexpr char MJ[] = "MJ";
   static constexpr char kvar[] = "kvar";
+  static constexpr char var[] = "var";
   static constexpr char kvarh[] = "kvarh";
+  static constexpr char varh[] = "varh";
 };
 
 const uint8_t GAS_MBUS_ID = 1;
@@ -180,28 +195,31 @@ const uint8_t SLAVE_MBUS_ID = 4;
 
 #define DEFINE_FIELD(fieldname, value_t, obis, field_t, field_args...) \
   struct fieldname : field_t<fieldname, ##field_args> { \
+    typedef value_t value_type; \
     value_t fieldname; \
     bool fieldname ## _present = false; \
     static constexpr ObisId id = obis; \
     static constexpr char name_progmem[] DSMR_PROGMEM = #fieldname; \
-    static constexpr const __FlashStringHelper *name = reinterpret_cast<const __FlashStringHelper*>(&name_progmem); \
+    static const __FlashStringHelper *name() { \
+      return reinterpret_cast<const __FlashStringHelper *>(name_progmem); \
+    } \
     value_t& val() { return fieldname; } \
     bool& present() { return fieldname ## _present; } \
   }
 
 /* Meter identification. This is not a normal field, but a
  * specially-formatted first line of the message */
-DEFINE_FIELD(identification, String, ObisId(255, 255, 255, 255, 255, 255), RawField);
+DEFINE_FIELD(identification, StringView, ObisId(255, 255, 255, 255, 255, 255), RawField);
 
 /* Version information for P1 output */
-DEFINE_FIELD(p1_version, String, ObisId(1, 3, 0, 2, 8), StringField, 2, 2);
-DEFINE_FIELD(p1_version_be, String, ObisId(0, 0, 96, 1, 4), StringField, 2, 5);
+DEFINE_FIELD(p1_version, StringView, ObisId(1, 3, 0, 2, 8), StringField, 2, 2);
+DEFINE_FIELD(p1_version_be, StringView, ObisId(0, 0, 96, 1, 4), StringField, 2, 5);
 
 /* Date-time stamp of the P1 message */
-DEFINE_FIELD(timestamp, String, ObisId(0, 0, 1, 0, 0), TimestampField);
+DEFINE_FIELD(timestamp, StringView, ObisId(0, 0, 1, 0, 0), TimestampField);
 
 /* Equipment identifier */
-DEFINE_FIELD(equipment_id, String, ObisId(0, 0, 96, 1, 1), StringField, 0, 96);
+DEFINE_FIELD(equipment_id, StringView, ObisId(0, 0, 96, 1, 1), StringField, 0, 96);
 
 /* Meter Reading electricity delivered to client (Special for Lux) in 0,001 kWh */
 DEFINE_FIELD(energy_delivered_lux, FixedValue, ObisId(1, 0, 1, 8, 0), FixedField, units::kWh, units::Wh);
@@ -219,13 +237,13 @@ DEFINE_FIELD(energy_returned_tariff2, FixedValue, ObisId(1, 0, 2, 8, 2), FixedFi
 /*
  * Extra fields used for Luxembourg
  */
-DEFINE_FIELD(total_imported_energy, FixedValue, ObisId(1, 0, 3, 8, 0), FixedField, units::kvarh, units::kvarh);
-DEFINE_FIELD(total_exported_energy, FixedValue, ObisId(1, 0, 4, 8, 0), FixedField, units::kvarh, units::kvarh);
+DEFINE_FIELD(total_imported_energy, FixedValue, ObisId(1, 0, 3, 8, 0), FixedField, units::kvarh, units::varh);
+DEFINE_FIELD(total_exported_energy, FixedValue, ObisId(1, 0, 4, 8, 0), FixedField, units::kvarh, units::varh);
 
 /* Tariff indicator electricity. The tariff indicator can also be used
  * to switch tariff dependent loads e.g boilers. This is the
  * responsibility of the P1 user */
-DEFINE_FIELD(electricity_tariff, String, ObisId(0, 0, 96, 14, 0), StringField, 4, 4);
+DEFINE_FIELD(electricity_tariff, StringView, ObisId(0, 0, 96, 14, 0), StringField, 4, 4);
 
 /* Actual electricity power delivered (+P) in 1 Watt resolution */
 DEFINE_FIELD(power_delivered, FixedValue, ObisId(1, 0, 1, 7, 0), FixedField, units::kW, units::W);
@@ -235,8 +253,8 @@ DEFINE_FIELD(power_returned, FixedValue, ObisId(1, 0, 2, 7, 0), FixedField, unit
 /*
  * Extra fields used for Luxembourg
  */
-DEFINE_FIELD(reactive_power_delivered, FixedValue, ObisId(1, 0, 3, 7, 0), FixedField, units::kvar, units::kvar);
-DEFINE_FIELD(reactive_power_returned, FixedValue, ObisId(1, 0, 4, 7, 0), FixedField, units::kvar, units::kvar);
+DEFINE_FIELD(reactive_power_delivered, FixedValue, ObisId(1, 0, 3, 7, 0), FixedField, units::kvar, units::var);
+DEFINE_FIELD(reactive_power_returned, FixedValue, ObisId(1, 0, 4, 7, 0), FixedField, units::kvar, units::var);
 
 /* The actual threshold Electricity in kW. Removed in 4.0.7 / 4.2.2 / 5.0 */
 DEFINE_FIELD(electricity_threshold, FixedValue, ObisId(0, 0, 17, 0, 0), FixedField, units::kW, units::W);
@@ -250,7 +268,7 @@ DEFINE_FIELD(electricity_failures, uint32_t, ObisId(0, 0, 96, 7, 21), IntField,
 DEFINE_FIELD(electricity_long_failures, uint32_t, ObisId(0, 0, 96, 7, 9), IntField, units::none);
 
 /* Power Failure Event Log (long power failures) */
-DEFINE_FIELD(electricity_failure_log, String, ObisId(1, 0, 99, 97, 0), RawField);
+DEFINE_FIELD(electricity_failure_log, StringView, ObisId(1, 0, 99, 97, 0), RawField);
 
 /* Number of voltage sags in phase L1 */
 DEFINE_FIELD(electricity_sags_l1, uint32_t, ObisId(1, 0, 32, 32, 0), IntField, units::none);
@@ -268,10 +286,10 @@ DEFINE_FIELD(electricity_swells_l3, uint32_t, ObisId(1, 0, 72, 36, 0), IntField,
 
 /* Text message codes: numeric 8 digits (Note: Missing from 5.0 spec)
  * */
-DEFINE_FIELD(message_short, String, ObisId(0, 0, 96, 13, 1), StringField, 0, 16);
+DEFINE_FIELD(message_short, StringView, ObisId(0, 0, 96, 13, 1), StringField, 0, 16);
 /* Text message max 2048 characters (Note: Spec says 1024 in comment and
  * 2048 in format spec, so we stick to 2048). */
-DEFINE_FIELD(message_long, String, ObisId(0, 0, 96, 13, 0), StringField, 0, 2048);
+DEFINE_FIELD(message_long, StringView, ObisId(0, 0, 96, 13, 0), StringField, 0, 2048);
 
 /* Instantaneous voltage L1 in 0.1V resolution (Note: Spec says V
  * resolution in comment, but 0.1V resolution in format spec. Added in
@@ -313,30 +331,30 @@ DEFINE_FIELD(power_returned_l3, FixedValue, ObisId(1, 0, 62, 7, 0), FixedField,
 /*
  * LUX
  */
-/* Instantaneous reactive power L1 (+Q) in W resolution */
-DEFINE_FIELD(reactive_power_delivered_l1, FixedValue, ObisId(1, 0, 23, 7, 0), FixedField, units::none, units::none);
-/* Instantaneous reactive power L2 (+Q) in W resolution */
-DEFINE_FIELD(reactive_power_delivered_l2, FixedValue, ObisId(1, 0, 43, 7, 0), FixedField, units::none, units::none);
-/* Instantaneous reactive power L3 (+Q) in W resolution */
-DEFINE_FIELD(reactive_power_delivered_l3, FixedValue, ObisId(1, 0, 63, 7, 0), FixedField, units::none, units::none);
+/* Instantaneous reactive power L1 (+Q) in var resolution */
+DEFINE_FIELD(reactive_power_delivered_l1, FixedValue, ObisId(1, 0, 23, 7, 0), FixedField, units::kvar, units::var);
+/* Instantaneous reactive power L2 (+Q) in var resolution */
+DEFINE_FIELD(reactive_power_delivered_l2, FixedValue, ObisId(1, 0, 43, 7, 0), FixedField, units::kvar, units::var);
+/* Instantaneous reactive power L3 (+Q) in var resolution */
+DEFINE_FIELD(reactive_power_delivered_l3, FixedValue, ObisId(1, 0, 63, 7, 0), FixedField, units::kvar, units::var);
 
 /*
  * LUX
  */
-/* Instantaneous reactive power L1 (-Q) in W resolution */
-DEFINE_FIELD(reactive_power_returned_l1, FixedValue, ObisId(1, 0, 24, 7, 0), FixedField, units::none, units::none);
-/* Instantaneous reactive power L2 (-Q) in W resolution */
-DEFINE_FIELD(reactive_power_returned_l2, FixedValue, ObisId(1, 0, 44, 7, 0), FixedField, units::none, units::none);
-/* Instantaneous reactive power L3 (-Q) in W resolution */
-DEFINE_FIELD(reactive_power_returned_l3, FixedValue, ObisId(1, 0, 64, 7, 0), FixedField, units::none, units::none);
+/* Instantaneous reactive power L1 (-Q) in var resolution */
+DEFINE_FIELD(reactive_power_returned_l1, FixedValue, ObisId(1, 0, 24, 7, 0), FixedField, units::kvar, units::var);
+/* Instantaneous reactive power L2 (-Q) in var resolution */
+DEFINE_FIELD(reactive_power_returned_l2, FixedValue, ObisId(1, 0, 44, 7, 0), FixedField, units::kvar, units::var);
+/* Instantaneous reactive power L3 (-Q) in var resolution */
+DEFINE_FIELD(reactive_power_returned_l3, FixedValue, ObisId(1, 0, 64, 7, 0), FixedField, units::kvar, units::var);
 
 /* Device-Type */
 DEFINE_FIELD(gas_device_type, uint16_t, ObisId(0, GAS_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Gas) */
-DEFINE_FIELD(gas_equipment_id, String, ObisId(0, GAS_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(gas_equipment_id, StringView, ObisId(0, GAS_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 /* Equipment identifier (Gas) BE */
-DEFINE_FIELD(gas_equipment_id_be, String, ObisId(0, GAS_MBUS_ID, 96, 1, 1), StringField, 0, 96);
+DEFINE_FIELD(gas_equipment_id_be, StringView, ObisId(0, GAS_MBUS_ID, 96, 1, 1), StringField, 0, 96);
 
 /* Valve position Gas (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(gas_valve_position, uint8_t, ObisId(0, GAS_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -353,7 +371,7 @@ DEFINE_FIELD(gas_delivered_be, TimestampedFixedValue, ObisId(0, GAS_MBUS_ID, 24,
 DEFINE_FIELD(thermal_device_type, uint16_t, ObisId(0, THERMAL_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(thermal_equipment_id, String, ObisId(0, THERMAL_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(thermal_equipment_id, StringView, ObisId(0, THERMAL_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(thermal_valve_position, uint8_t, ObisId(0, THERMAL_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -367,7 +385,7 @@ DEFINE_FIELD(thermal_delivered, TimestampedFixedValue, ObisId(0, THERMAL_MBUS_ID
 DEFINE_FIELD(water_device_type, uint16_t, ObisId(0, WATER_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(water_equipment_id, String, ObisId(0, WATER_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(water_equipment_id, StringView, ObisId(0, WATER_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(water_valve_position, uint8_t, ObisId(0, WATER_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -381,7 +399,7 @@ DEFINE_FIELD(water_delivered, TimestampedFixedValue, ObisId(0, WATER_MBUS_ID, 24
 DEFINE_FIELD(slave_device_type, uint16_t, ObisId(0, SLAVE_MBUS_ID, 24, 1, 0), IntField, units::none);
 
 /* Equipment identifier (Thermal: heat or cold) */
-DEFINE_FIELD(slave_equipment_id, String, ObisId(0, SLAVE_MBUS_ID, 96, 1, 0), StringField, 0, 96);
+DEFINE_FIELD(slave_equipment_id, StringView, ObisId(0, SLAVE_MBUS_ID, 96, 1, 0), StringField, 0, 96);
 
 /* Valve position (on/off/released) (Note: Removed in 4.0.7 / 4.2.2 / 5.0). */
 DEFINE_FIELD(slave_valve_position, uint8_t, ObisId(0, SLAVE_MBUS_ID, 24, 4, 0), IntField, units::none);
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "esphome/components/sensor/sensor.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <limits>
+#include <string>
+
+namespace esphome {
+namespace dsmr_ {
+
+// The last readings of a numeric field, in raw units (e.g. thousandths of
+// a kW). Consecutive readings differ little, so every reading but the
+// oldest is stored as its difference from the one before, in 32 bits.
+class History {
+ public:
+  // Number of readings kept. The buffer is allocated in allocate().
+  void set_capacity(size_t capacity) { this->capacity_ = capacity; }
+  void allocate() {
+    if (this->capacity_ > 0)
+      this->deltas_ = new int32_t[this->capacity_];
+  }
+
+  size_t capacity() const { return this->capacity_; }
+  size_t size() const { return this->size_; }
+  bool empty() const { return this->size_ == 0; }
+  int64_t oldest() const { return this->oldest_; }
+  int64_t newest() const { return this->newest_; }
+
+  void clear() {
+    this->head_ = 0;
+    this->size_ = 0;
+  }
+
+  // Adds a reading, dropping the oldest one when full
+  void add(int64_t value) {
+    if (this->deltas_ == nullptr)
+      return;
+    const int64_t delta = value - this->newest_;
+    // A jump that does not fit (like a meter that was replaced) starts over
+    if (this->size_ > 0 &&
+        (delta < std::numeric_limits<int32_t>::min() || delta > std::numeric_limits<int32_t>::max()))
+      this->clear();
+    if (this->size_ == this->capacity_) {
+      this->head_ = (this->head_ + 1) % this->capacity_;
+      this->size_--;
+      if (this->size_ > 0)
+        this->oldest_ += this->deltas_[this->head_];
+    }
+    if (this->size_ == 0)
+      this->oldest_ = value;
+    else
+      this->deltas_[(this->head_ + this->size_) % this->capacity_] = delta;
+    this->newest_ = value;
+    this->size_++;
+  }
+
+  // Calls f with every reading, from the oldest to the newest
+  template<typename F> void for_each(F f) const {
+    int64_t value = this->oldest_;
+    for (size_t i = 0; i < this->size_; i++) {
+      if (i > 0)
+        value += this->deltas_[(this->head_ + i) % this->capacity_];
+      f(value);
+    }
+  }
+
+  int64_t min() const {
+    int64_t min = this->oldest_;
+    this->for_each([&min](int64_t value) { min = value < min ? value : min; });
+    return min;
+  }
+  int64_t max() const {
+    int64_t max = this->oldest_;
+    this->for_each([&max](int64_t value) { max = value > max ? value : max; });
+    return max;
+  }
+
+ protected:
+  size_t capacity_{0};
+  int32_t *deltas_{nullptr};
+  // deltas_[head_] belongs to the oldest reading, which is kept in full
+  // in oldest_ instead
+  size_t head_{0};
+  size_t size_{0};
+  int64_t oldest_{0};
+  int64_t newest_{0};
+};
+
+// Returned for fields without a history
+inline const History &empty_history() {
+  static const History EMPTY;
+  return EMPTY;
+}
+
+// Minimum, maximum and mean of a numeric field over fixed intervals, and
+// how much it changed (like the energy used in the interval). Each is
+// published as a sensor at the end of every interval.
+struct Aggregate {
+  // Adds a reading in raw units, scale raw units make one unit of the
+  // published values
+  void add(int64_t value, uint32_t now, uint32_t scale) {
+    this->update(now);
+    if (!this->has_reference) {
+      this->start = now;
+      this->reference = value;
+      this->has_reference = true;
+    }
+    if (this->count == 0) {
+      this->min = this->max = value;
+      this->sum = 0;
+    }
+    this->min = value < this->min ? value : this->min;
+    this->max = value > this->max ? value : this->max;
+    this->sum += value;
+    this->last = value;
+    this->count++;
+    this->scale = scale;
+  }
+
+  // Closes the current interval once it has ended, and publishes it
+  // unless it had no readings. This is called from loop() as well, so an
+  // interval is published when it ends rather than with the next reading.
+  void update(uint32_t now) {
+    if (!this->has_reference || now - this->start < this->interval)
+      return;
+    if (this->count > 0)
+      this->publish_();
+    // Keep the intervals aligned, also over intervals without readings
+    this->start += (now - this->start) / this->interval * this->interval;
+    this->count = 0;
+  }
+
+  // Publishes in the integer unit, like the field's own sensor with int_unit
+  void set_int_unit(const std::string &unit) {
+    for (sensor::Sensor *sensor : {this->min_sensor, this->max_sensor, this->mean_sensor, this->delta_sensor}) {
+      if (sensor != nullptr) {
+        sensor->set_unit_of_measurement(unit);
+        sensor->set_accuracy_decimals(0);
+      }
+    }
+  }
+
+  // Length of an interval in ms
+  uint32_t interval{0};
+  sensor::Sensor *min_sensor{nullptr};
+  sensor::Sensor *max_sensor{nullptr};
+  sensor::Sensor *mean_sensor{nullptr};
+  sensor::Sensor *delta_sensor{nullptr};
+
+  // The current interval
+  uint32_t start{0};
+  uint32_t count{0};
+  int64_t min{0};
+  int64_t max{0};
+  int64_t sum{0};
+  int64_t last{0};
+  // Raw units per unit of the published values
+  uint32_t scale{1};
+  // The last reading of the previous interval, which the change is
+  // measured from
+  int64_t reference{0};
+  bool has_reference{false};
+
+ protected:
+  void publish_() {
+    const double s = this->scale;
+    if (this->min_sensor != nullptr)
+      this->min_sensor->publish_state(this->min / s);
+    if (this->max_sensor != nullptr)
+      this->max_sensor->publish_state(this->max / s);
+    if (this->mean_sensor != nullptr)
+      this->mean_sensor->publish_state((double) this->sum / this->count / s);
+    if (this->delta_sensor != nullptr)
+      this->delta_sensor->publish_state((this->last - this->reference) / s);
+    this->reference = this->last;
+  }
+};
+
+}  // namespace dsmr_
+}  // namespace esphome
@@ -31,7 +31,7 @@
 #ifndef DSMR_INCLUDE_PARSER_H
 #define DSMR_INCLUDE_PARSER_H
 
-#include "crc16.h"
+#include "crc.h"
 #include "util.h"
 
 namespace dsmr {
@@ -66,18 +66,23 @@ template<typename... Ts> struct ParsedData;
  * Base case: No fields present.
  */
 template<> struct ParsedData<> {
-  ParseResult<void> __attribute__((__always_inline__))
-  parse_line_inlined(const ObisId & /* id */, const char *str, const char * /* end */) {
+  ParseResult<void> parse_line(const ObisId & /* id */, const char *str, const char * /* end */) {
     // Parsing succeeded, but found no matching handler (so return
     // set the next pointer to show nothing was parsed).
     return ParseResult<void>().until(str);
   }
 
+  static bool has_field(const ObisId & /* id */) { return false; }
+
   template<typename F> void __attribute__((__always_inline__)) applyEach_inlined(F && /* f */) {
     // Nothing to do
   }
 
   bool all_present_inlined() { return true; }
+
+  void reset() {}
+
+  void __attribute__((__always_inline__)) reset_inlined() {}
 };
 
 // Do not use F() for multiply-used strings (including strings used from
@@ -85,35 +90,113 @@ template<> struct ParsedData<> {
 // instances of the string in the binary
 static constexpr char DUPLICATE_FIELD[] DSMR_PROGMEM = "Duplicate field";
 
+// The bit filter of FieldTable can be disabled to measure what it saves
+#ifndef DSMR_FIELD_FILTER
+#define DSMR_FIELD_FILTER 1
+#endif
+
+/**
+ * Lookup table from OBIS id to the parse function of a field, generated
+ * at compile time for the fields Fs of a ParsedData type. The entries are
+ * sorted by OBIS id, so a line is dispatched with a binary search
+ * instead of comparing its id against every field in turn. A perfect
+ * hash would avoid the few remaining compares, but needs a sparse table
+ * that costs more RAM than an ESP8266 can spare.
+ *
+ * Usually only a few of the lines in a telegram are for fields in the
+ * table, so a 256 bit filter with a bit per hashed id is checked first.
+ * That rules out most other lines with a single bit test.
+ */
+template<typename Data, typename... Fs> struct FieldTable {
+  using Handler = ParseResult<void> (*)(Data *data, const char *str, const char *end);
+
+  struct Entry {
+    uint64_t key;
+    Handler handler;
+  };
+
+  static constexpr size_t size = sizeof...(Fs);
+
+  constexpr FieldTable() : entries{{Fs::id.key(), &parse_field<Fs>}...}, filter() {
+    for (size_t i = 0; i < size; ++i) {
+      uint8_t hash = filter_hash(entries[i].key);
+      filter[hash / 32] |= 1UL << (hash % 32);
+    }
+    // Insertion sort, which is stable. When two fields share an id, the
+    // first one in the field list wins, just like a linear search would.
+    for (size_t i = 1; i < size; ++i) {
+      for (size_t j = i; j > 0 && entries[j - 1].key > entries[j].key; --j) {
+        Entry tmp = entries[j];
+        entries[j] = entries[j - 1];
+        entries[j - 1] = tmp;
+      }
+    }
+  }
+
+  /**
+   * Returns the parse function for the given OBIS id, or nullptr when
+   * there is no field with that id.
+   */
+  Handler find(const ObisId &id) const {
+    uint64_t key = id.key();
+#if DSMR_FIELD_FILTER
+    uint8_t hash = filter_hash(key);
+    if (!(filter[hash / 32] & (1UL << (hash % 32))))
+      return nullptr;
+#endif
+
+    size_t lo = 0, hi = size;
+    while (lo < hi) {
+      size_t mid = (lo + hi) / 2;
+      if (entries[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    return lo < size && entries[lo].key == key ? entries[lo].handler : nullptr;
+  }
+
+  template<typename F> static ParseResult<void> parse_field(Data *data, const char *str, const char *end) {
+    F &field = *data;
+    if (field.present())
+      return ParseResult<void>().fail((const __FlashStringHelper *) DUPLICATE_FIELD, str);
+    field.present() = true;
+    return field.parse(str, end);
+  }
+
+  // Multiplicative hash, using only 32 bit operations
+  static constexpr uint8_t filter_hash(uint64_t key) {
+    return ((uint32_t(key) ^ uint32_t(key >> 32) * 0x01000193UL) * 0x9E3779B1UL) >> 24;
+  }
+
+  Entry entries[size];
+  uint32_t filter[8];
+};
+
 /**
  * General case: At least one typename is passed.
  */
 template<typename T, typename... Ts> struct ParsedData<T, Ts...> : public T, ParsedData<Ts...> {
   /**
    * This method is used by the parser to parse a single line. The
-   * OBIS id of the line is passed, and this method recursively finds a
-   * field with a matching id. If any, it calls it's parse method, which
+   * OBIS id of the line is passed, and this method looks up the field
+   * with a matching id. If any, it calls it's parse method, which
    * parses the value and stores it in the field.
    */
   ParseResult<void> parse_line(const ObisId &id, const char *str, const char *end) {
-    return parse_line_inlined(id, str, end);
+    typename Table::Handler handler = table().find(id);
+    if (!handler) {
+      // Parsing succeeded, but found no matching handler (so return
+      // set the next pointer to show nothing was parsed).
+      return ParseResult<void>().until(str);
+    }
+    return handler(this, str, end);
   }
 
   /**
-   * always_inline version of parse_line. This is a separate method, to
-   * allow recursively inlining all calls, but still have a non-inlined
-   * top-level parse_line method.
+   * Returns true when there is a field with the given OBIS id.
    */
-  ParseResult<void> __attribute__((__always_inline__))
-  parse_line_inlined(const ObisId &id, const char *str, const char *end) {
-    if (id == T::id) {
-      if (T::present())
-        return ParseResult<void>().fail((const __FlashStringHelper *) DUPLICATE_FIELD, str);
-      T::present() = true;
-      return T::parse(str, end);
-    }
-    return ParsedData<Ts...>::parse_line_inlined(id, str, end);
-  }
+  static bool has_field(const ObisId &id) { return table().find(id) != nullptr; }
 
   template<typename F> void applyEach(F &&f) { applyEach_inlined(f); }
 
@@ -128,11 +211,30 @@ template<typename T, typename... Ts> struct ParsedData<T, Ts...> : public T, Par
   bool all_present() { return all_present_inlined(); }
 
   bool all_present_inlined() { return T::present() && ParsedData<Ts...>::all_present_inlined(); }
+
+  /**
+   * Marks all fields as not present, so the same instance can be reused
+   * for parsing the next message.
+   */
+  void reset() { reset_inlined(); }
+
+  void __attribute__((__always_inline__)) reset_inlined() {
+    T::reset();
+    ParsedData<Ts...>::reset_inlined();
+  }
+
+ protected:
+  using Table = FieldTable<ParsedData, T, Ts...>;
+
+  static const Table &table() {
+    static constexpr Table table{};
+    return table;
+  }
 };
 
 struct StringParser {
-  static ParseResult<String> parse_string(size_t min, size_t max, const char *str, const char *end) {
-    ParseResult<String> res;
+  static ParseResult<StringView> parse_string(size_t min, size_t max, const char *str, const char *end) {
+    ParseResult<StringView> res;
     if (str >= end || *str != '(')
       return res.fail(F("Missing ("), str);
 
@@ -149,9 +251,7 @@ struct StringParser {
     if (len < min || len > max)
       return res.fail(F("Invalid string length"), str_start);
 
-    concat_hack(res.result, str_start, len);
-
-    return res.until(str_end + 1);  // Skip )
+    return res.succeed(StringView(str_start, len)).until(str_end + 1);  // Skip )
   }
 };
 
@@ -160,43 +260,80 @@ struct StringParser {
 // instances of the string in the binary
 static constexpr char INVALID_NUMBER[] DSMR_PROGMEM = "Invalid number";
 static constexpr char INVALID_UNIT[] DSMR_PROGMEM = "Invalid unit";
+static constexpr char NUMBER_TOO_LARGE[] DSMR_PROGMEM = "Number too large";
+
+// Parse numbers 8 digits at a time where possible. This assumes a little
+// endian CPU, like the ESP8266 and ESP32.
+#ifndef DSMR_NUM_PARSER_SWAR
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define DSMR_NUM_PARSER_SWAR 1
+#else
+#define DSMR_NUM_PARSER_SWAR 0
+#endif
+#endif
 
 struct NumParser {
-  static ParseResult<uint32_t> parse(size_t max_decimals, const char *unit, const char *str, const char *end) {
-    ParseResult<uint32_t> res;
+  /**
+   * Parses a number with up to max_decimals decimals into an integer of
+   * type T, multiplied by 10^max_decimals. Numbers that do not fit in T
+   * are an error.
+   */
+  template<typename T>
+  static ParseResult<T> parse(size_t max_decimals, const char *unit, const char *str, const char *end) {
+    ParseResult<T> res;
     if (str >= end || *str != '(')
       return res.fail(F("Missing ("), str);
 
     const char *num_start = str + 1;  // Skip (
     const char *num_end = num_start;
 
-    uint32_t value = 0;
-
-    // Parse integer part
-    while (num_end < end && !strchr("*.)", *num_end)) {
-      if (*num_end < '0' || *num_end > '9')
-        return res.fail((const __FlashStringHelper *) INVALID_NUMBER, num_end);
-      value *= 10;
-      value += *num_end - '0';
+    T value = 0;
+
+    // Parse integer part, up to 8 digits at a time while there are at
+    // least 8 bytes left
+#if DSMR_NUM_PARSER_SWAR
+    while (end - num_end >= 8) {
+      uint64_t chunk;
+      memcpy(&chunk, num_end, sizeof(chunk));
+      size_t digits = count_digits(chunk);
+      if (digits > 0) {
+        if (!add_digits(value, parse_digits(chunk, digits), digits))
+          return res.fail((const __FlashStringHelper *) NUMBER_TOO_LARGE, num_start);
+        num_end += digits;
+      }
+      if (digits < 8)
+        break;
+    }
+#endif
+    while (num_end < end && *num_end >= '0' && *num_end <= '9') {
+      if (!add_digit(value, *num_end - '0'))
+        return res.fail((const __FlashStringHelper *) NUMBER_TOO_LARGE, num_start);
       ++num_end;
     }
+    // The digits should end with a delimiter. A nul byte is accepted as
+    // well, for compatibility with the strchr() this used to be.
+    if (num_end < end && *num_end != '*' && *num_end != '.' && *num_end != ')' && *num_end != '\0')
+      return res.fail((const __FlashStringHelper *) INVALID_NUMBER, num_end);
 
     // Parse decimal part, if any
     if (max_decimals && num_end < end && *num_end == '.') {
       ++num_end;
 
-      while (num_end < end && !strchr("*)", *num_end) && max_decimals--) {
+      while (num_end < end && *num_end != '*' && *num_end != ')' && *num_end != '\0' && max_decimals > 0) {
         if (*num_end < '0' || *num_end > '9')
           return res.fail((const __FlashStringHelper *) INVALID_NUMBER, num_end);
-        value *= 10;
-        value += *num_end - '0';
+        if (!add_digit(value, *num_end - '0'))
+          return res.fail((const __FlashStringHelper *) NUMBER_TOO_LARGE, num_start);
+        --max_decimals;
         ++num_end;
       }
     }
 
     // Fill in missing decimals with zeroes
-    while (max_decimals--)
-      value *= 10;
+    for (; max_decimals > 0; --max_decimals) {
+      if (!add_digit(value, 0))
+        return res.fail((const __FlashStringHelper *) NUMBER_TOO_LARGE, num_start);
+    }
 
     if (unit && *unit) {
       if (num_end >= end || *num_end != '*')
@@ -215,6 +352,46 @@ struct NumParser {
 
     return res.succeed(value).until(num_end + 1);  // Skip )
   }
+
+ protected:
+  // value = value * 10 + digit, returns false on overflow
+  template<typename T> static bool add_digit(T &value, uint8_t digit) {
+    return !__builtin_mul_overflow(value, 10, &value) && !__builtin_add_overflow(value, digit, &value);
+  }
+
+#if DSMR_NUM_PARSER_SWAR
+  // The functions below handle 8 characters at once, loaded into a 64 bit
+  // integer with the first character in the lowest byte ("SIMD within a
+  // register").
+
+  // Number of leading digits in chunk
+  static size_t count_digits(uint64_t chunk) {
+    // '0'..'9' become 0..9. Adding 0x76 sets the top bit of the bytes that
+    // are 10 or more, bytes that already had it set are non-digits too.
+    uint64_t x = chunk ^ 0x3030303030303030ULL;
+    uint64_t non_digits = (x | ((x & 0x7F7F7F7F7F7F7F7FULL) + 0x7676767676767676ULL)) & 0x8080808080808080ULL;
+    return non_digits ? __builtin_ctzll(non_digits) / 8 : 8;
+  }
+
+  // Value of the first 1-8 digits in chunk
+  static uint32_t parse_digits(uint64_t chunk, size_t digits) {
+    // Shift out the characters after the digits, which leaves zeroes
+    // (leading zero digits) at the start
+    uint64_t x = (chunk ^ 0x3030303030303030ULL) << (8 * (8 - digits));
+    // Combine pairs of digits, then groups of four, then all eight
+    x = x * 10 + (x >> 8);
+    x = (((x & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))) +
+         (((x >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+    return x;
+  }
+
+  // value = value * 10^digits + digits_value, returns false on overflow
+  template<typename T> static bool add_digits(T &value, uint32_t digits_value, size_t digits) {
+    static constexpr uint32_t POW10[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+    return !__builtin_mul_overflow(value, POW10[digits], &value) &&
+           !__builtin_add_overflow(value, digits_value, &value);
+  }
+#endif
 };
 
 struct ObisIdParser {
@@ -285,48 +462,67 @@ struct CrcParser {
   }
 };
 
+static constexpr char CHECKSUM_MISMATCH[] DSMR_PROGMEM = "Checksum mismatch";
+static constexpr char INVALID_CHARACTER[] DSMR_PROGMEM = "Invalid character";
+
+// Text fields may hold any other byte (like a tab or UTF-8), but a NUL never
+// appears in a telegram. It does show up on a noisy or disconnected line,
+// so a telegram is dropped at the first one, without waiting for the
+// checksum.
+inline bool is_invalid_character(char c) { return c == '\0'; }
+
 struct P1Parser {
   /**
-   * Parse a complete P1 telegram. The string passed should start
-   * with '/' and run up to and including the ! and the following
-   * four byte checksum. It's ok if the string is longer, the .next
-   * pointer in the result will indicate the next unprocessed byte.
+   * Check the checksum of a complete P1 telegram, without looking at
+   * the data. The string passed should start with '/' and run up to and
+   * including the ! and the following four byte checksum. On success,
+   * the result is the ! that ends the data and .next points to the next
+   * unprocessed byte. On a checksum mismatch, the context points to the
+   * received checksum, right after the data it covers.
    */
-  template<typename... Ts>
-  static ParseResult<void> parse(ParsedData<Ts...> *data, const char *str, size_t n, bool unknown_error = false) {
-    ParseResult<void> res;
+  static ParseResult<const char *> check(const char *str, size_t n) {
+    ParseResult<const char *> res;
     if (!n || str[0] != '/')
       return res.fail(F("Data should start with /"), str);
 
-    // Skip /
-    const char *data_start = str + 1;
-
     // Look for ! that terminates the data
-    const char *data_end = data_start;
-    uint16_t crc = _crc16_update(0, *str);  // Include the / in CRC
-    while (data_end < str + n && *data_end != '!') {
-      crc = _crc16_update(crc, *data_end);
-      ++data_end;
-    }
+    const char *data_end = static_cast<const char *>(memchr(str + 1, '!', n - 1));
+    if (!data_end)
+      return res.fail(F("No checksum found"), str + n);
 
-    if (data_end >= str + n)
-      return res.fail(F("No checksum found"), data_end);
+    // Same as P1StreamParser, which drops the telegram at the first one
+    const char *invalid = static_cast<const char *>(memchr(str, '\0', data_end - str));
+    if (invalid)
+      return res.fail((const __FlashStringHelper *) INVALID_CHARACTER, invalid);
 
-    crc = _crc16_update(crc, *data_end);  // Include the ! in CRC
+    // Include both the / and the ! in CRC
+    uint16_t crc = crc16_update(0, str, data_end - str + 1);
 
     ParseResult<uint16_t> check_res = CrcParser::parse(data_end + 1, str + n);
     if (check_res.err)
       return check_res;
 
-    // Check CRC
-    if (check_res.result != crc) {
-      Serial.println(check_res.result);
-      Serial.println(crc);
+    if (check_res.result != crc)
+      return res.fail((const __FlashStringHelper *) CHECKSUM_MISMATCH, data_end + 1);
 
-      return res.fail(F("Checksum mismatch"), data_end + 1);
-    }
+    return res.succeed(data_end).until(check_res.next);
+  }
+
+  /**
+   * Parse a complete P1 telegram. The string passed should start
+   * with '/' and run up to and including the ! and the following
+   * four byte checksum. It's ok if the string is longer, the .next
+   * pointer in the result will indicate the next unprocessed byte.
+   * data is only touched when the checksum is correct.
+   */
+  template<typename... Ts>
+  static ParseResult<void> parse(ParsedData<Ts...> *data, const char *str, size_t n, bool unknown_error = false) {
+    ParseResult<const char *> check_res = check(str, n);
+    if (check_res.err)
+      return check_res;
 
-    res = parse_data(data, data_start, data_end, unknown_error);
+    // Skip /
+    ParseResult<void> res = parse_data(data, str + 1, check_res.result, unknown_error);
     res.next = check_res.next;
     return res;
   }
@@ -341,51 +537,63 @@ struct P1Parser {
                                       bool unknown_error = false) {
     ParseResult<void> res;
     // Split into lines and parse those
-    const char *line_end = str, *line_start = str;
+    const char *line_start = str;
+    const char *line_end = find_line_end(line_start, end);
 
     // Parse ID line
-    while (line_end < end) {
-      if (*line_end == '\r' || *line_end == '\n') {
-        // The first identification line looks like:
-        // XXX5<id string>
-        // The DSMR spec is vague on details, but in 62056-21, the X's
-        // are a three-leter (registerd) manufacturer ID, the id
-        // string is up to 16 chars of arbitrary characters and the
-        // '5' is a baud rate indication. 5 apparently means 9600,
-        // which DSMR 3.x and below used. It seems that DSMR 2.x
-        // passed '3' here (which is mandatory for "mode D"
-        // communication according to 62956-21), so we also allow
-        // that.
-        if (line_start + 3 >= line_end || (line_start[3] != '5' && line_start[3] != '3'))
-          return res.fail(F("Invalid identification string"), line_start);
-        // Offer it for processing using the all-ones Obis ID, which
-        // is not otherwise valid.
-        ParseResult<void> tmp = data->parse_line(ObisId(255, 255, 255, 255, 255, 255), line_start, line_end);
-        if (tmp.err)
-          return tmp;
-        line_start = ++line_end;
-        break;
-      }
-      ++line_end;
+    if (line_end < end) {
+      ParseResult<void> tmp = parse_id_line(data, line_start, line_end);
+      if (tmp.err)
+        return tmp;
+      line_start = line_end + 1;
+      line_end = find_line_end(line_start, end);
     }
 
     // Parse data lines
     while (line_end < end) {
-      if (*line_end == '\r' || *line_end == '\n') {
-        ParseResult<void> tmp = parse_line(data, line_start, line_end, unknown_error);
-        if (tmp.err)
-          return tmp;
-        line_start = line_end + 1;
-      }
-      line_end++;
+      ParseResult<void> tmp = parse_line(data, line_start, line_end, unknown_error);
+      if (tmp.err)
+        return tmp;
+      line_start = line_end + 1;
+      line_end = find_line_end(line_start, end);
     }
 
-    if (line_end != line_start)
-      return res.fail(F("Last dataline not CRLF terminated"), line_end);
+    if (end != line_start)
+      return res.fail(F("Last dataline not CRLF terminated"), end);
 
     return res;
   }
 
+  /**
+   * Returns the first CR or LF between str and end, or end if there is
+   * none. memchr() is a lot faster than checking every byte here.
+   */
+  static const char *find_line_end(const char *str, const char *end) {
+    const char *lf = static_cast<const char *>(memchr(str, '\n', end - str));
+    if (lf == nullptr)
+      lf = end;
+    const char *cr = static_cast<const char *>(memchr(str, '\r', lf - str));
+    return cr != nullptr ? cr : lf;
+  }
+
+  template<typename Data> static ParseResult<void> parse_id_line(Data *data, const char *line, const char *end) {
+    // The first identification line looks like:
+    // XXX5<id string>
+    // The DSMR spec is vague on details, but in 62056-21, the X's
+    // are a three-leter (registerd) manufacturer ID, the id
+    // string is up to 16 chars of arbitrary characters and the
+    // '5' is a baud rate indication. 5 apparently means 9600,
+    // which DSMR 3.x and below used. It seems that DSMR 2.x
+    // passed '3' here (which is mandatory for "mode D"
+    // communication according to 62956-21), so we also allow
+    // that.
+    if (line + 3 >= end || (line[3] != '5' && line[3] != '3'))
+      return ParseResult<void>().fail(F("Invalid identification string"), line);
+    // Offer it for processing using the all-ones Obis ID, which
+    // is not otherwise valid.
+    return data->parse_line(ObisId(255, 255, 255, 255, 255, 255), line, end);
+  }
+
   template<typename Data>
   static ParseResult<void> parse_line(Data *data, const char *line, const char *end, bool unknown_error) {
     ParseResult<void> res;
@@ -412,6 +620,257 @@ struct P1Parser {
   }
 };
 
+// Do not use F() for multiply-used strings (including strings used from
+// multiple template instantiations), that would result in multiple
+// instances of the string in the binary
+static constexpr char BUFFER_OVERFLOW[] DSMR_PROGMEM = "Message larger than buffer";
+
+/**
+ * Incremental version of P1Parser. Instead of parsing a complete
+ * telegram at once, bytes are fed to it as they arrive from the meter.
+ * The checksum is updated on the fly, a line at a time, so once the
+ * checksum itself has been received it only has to be compared. Only
+ * then are the data lines parsed, so a corrupted telegram costs no
+ * parsing at all.
+ *
+ * Received bytes are stored in the buffer passed to the constructor, so
+ * lines can be parsed in one piece and errors can point out their
+ * context. The result is the same as P1Parser::parse() would return for
+ * the same bytes, and like there, data is only touched when the checksum
+ * is correct.
+ *
+ * With skip_unused set, lines without a field in Data are checksummed but
+ * not kept in the buffer, so it only needs to hold the lines that are
+ * used. A line that does not fit in the buffer is dropped as soon as its
+ * OBIS id shows that it is not used, which allows for long lines (like a
+ * failure log or message) that are not needed anyway.
+ */
+template<typename Data> struct P1StreamParser {
+  P1StreamParser(char *buf, size_t size) : buf(buf), size(size) {}
+
+  // Sets the buffer to store received bytes in, before start()
+  void set_buffer(char *buf, size_t size) {
+    this->buf = buf;
+    this->size = size;
+  }
+
+  /**
+   * Start parsing a new telegram into the given data. The first byte fed
+   * afterwards should be the leading /.
+   */
+  void start(Data *data) {
+    this->data = data;
+    this->state = State::ID_LINE;
+    this->len = 0;
+    this->line_start = 1;  // Skip the leading /
+    this->crc = 0;
+    this->crc_pos = 0;
+    this->res = ParseResult<void>();
+  }
+
+  /**
+   * Feed received bytes to the parser. Returns the number of bytes
+   * consumed, which is less than n when the telegram was completed (or
+   * failed) halfway. Bytes fed after that are ignored until start() is
+   * called again.
+   */
+  size_t feed(const char *str, size_t n) {
+    size_t i = 0;
+    while (i < n && this->state != State::DONE) {
+      if (this->state == State::SKIP_LINE) {
+        // Only checksum the rest of a dropped line
+        size_t run = 0;
+        while (i + run < n && is_plain(str[i + run]))
+          ++run;
+        this->crc = crc16_update(this->crc, str + i, run);
+        i += run;
+        if (i == n)
+          break;
+        this->skip_byte(str[i++]);
+        continue;
+      }
+      // Copy the bytes up to the next line end, ! or invalid character at
+      // once, only those need to be looked at by feed_byte()
+      if (this->len > 0 && this->state != State::CHECKSUM) {
+        size_t run = 0;
+        const size_t max = n - i < this->size - this->len ? n - i : this->size - this->len;
+        while (run < max && is_plain(str[i + run]))
+          ++run;
+        memcpy(this->buf + this->len, str + i, run);
+        this->len += run;
+        i += run;
+        if (i == n)
+          break;
+      }
+      this->feed_byte(str[i++]);
+    }
+    return i;
+  }
+
+  /**
+   * Returns true when the checksum was received or parsing was aborted.
+   * The result is only meaningful after that.
+   */
+  bool done() const { return this->state == State::DONE; }
+  const ParseResult<void> &result() const { return this->res; }
+
+  // Number of bytes of the current telegram stored in the buffer
+  size_t length() const { return this->len; }
+
+  // Checksum calculated over the received bytes, up to and including the !
+  uint16_t checksum() const { return this->crc; }
+
+  // When set, unknown fields are reported as an error
+  bool unknown_error = false;
+  // When set, lines without a field are not kept in the buffer
+  bool skip_unused = false;
+
+ protected:
+  enum class State : uint8_t { ID_LINE, DATA, SKIP_LINE, CHECKSUM, DONE };
+
+  static bool is_special(char c) { return c == '\r' || c == '\n' || c == '!'; }
+
+  // Returns true for the characters that need no further checks
+  static bool is_plain(char c) { return !is_special(c) && !is_invalid_character(c); }
+
+  // Aborts on a byte that cannot be part of a telegram, see
+  // is_invalid_character()
+  void invalid_character(const char *ctx) {
+    this->res = ParseResult<void>().fail((const __FlashStringHelper *) INVALID_CHARACTER, ctx);
+    this->state = State::DONE;
+  }
+
+  void feed_byte(char c) {
+    if (this->len >= this->size) {
+      if (this->is_unused(this->buf + this->line_start, this->buf + this->len, true)) {
+        this->drop_line();
+        this->state = State::SKIP_LINE;
+        this->skip_byte(c);
+        return;
+      }
+      this->res = ParseResult<void>().fail((const __FlashStringHelper *) BUFFER_OVERFLOW);
+      this->state = State::DONE;
+      return;
+    }
+    this->buf[this->len++] = c;
+
+    if (is_invalid_character(c)) {
+      this->invalid_character(this->buf + this->len - 1);
+      return;
+    }
+
+    if (this->len == 1 && c != '/') {
+      this->res = ParseResult<void>().fail(F("Data should start with /"), this->buf);
+      this->state = State::DONE;
+      return;
+    }
+
+    if (this->state == State::CHECKSUM) {
+      if (this->len - this->line_start == CrcParser::CRC_LEN)
+        this->check_crc();
+      return;
+    }
+
+    if (c == '\r' || c == '\n') {
+      this->update_crc();
+      this->end_line(this->len - 1);
+    } else if (c == '!') {
+      this->update_crc();
+      this->line_start = this->len;
+      this->state = State::CHECKSUM;
+    }
+  }
+
+  // The checksum is updated a line at a time, which is a lot faster
+  // than doing it for every byte
+  void update_crc() {
+    this->crc = crc16_update(this->crc, this->buf + this->crc_pos, this->len - this->crc_pos);
+    this->crc_pos = this->len;
+  }
+
+  // Handles a byte of a dropped line
+  void skip_byte(char c) {
+    if (!is_special(c)) {
+      if (is_invalid_character(c))
+        this->invalid_character(nullptr);
+      else
+        this->crc = crc16_update(this->crc, c);
+      return;
+    }
+    this->state = State::DATA;
+    if (c == '!') {
+      // The dropped line is no longer in the buffer for parse_data() to
+      // notice that it was not CRLF terminated
+      if (!this->res.err)
+        this->res.fail(F("Last dataline not CRLF terminated"), this->buf + this->len);
+      this->feed_byte(c);
+    } else {
+      this->crc = crc16_update(this->crc, c);
+    }
+  }
+
+  /**
+   * Returns true when the (partial) data line from line to end can be
+   * dropped, because there is no field for its OBIS id. With partial
+   * set, the line may not be complete yet, so the id should be followed
+   * by a ( to be sure it is complete.
+   */
+  bool is_unused(const char *line, const char *end, bool partial) const {
+    if (!this->skip_unused || this->unknown_error || this->state != State::DATA || line == end)
+      return false;
+    ParseResult<ObisId> idres = ObisIdParser::parse(line, end);
+    if (idres.err || (partial && (idres.next == end || *idres.next != '(')))
+      return false;
+    return !Data::has_field(idres.result);
+  }
+
+  // Removes the current line from the buffer, after checksumming it
+  void drop_line() {
+    this->update_crc();
+    this->len = this->line_start;
+    this->crc_pos = this->len;
+  }
+
+  void end_line(size_t line_end) {
+    const char *line = this->buf + this->line_start;
+    const char *end = this->buf + line_end;
+    if (this->is_unused(line, end, false)) {
+      this->drop_line();
+      return;
+    }
+    this->line_start = line_end + 1;
+    // Only the data lines after the id line can be dropped
+    this->state = State::DATA;
+  }
+
+  // Compares the checksum, and parses the kept lines when it matches
+  void check_crc() {
+    const char *crc_start = this->buf + this->line_start;
+    ParseResult<uint16_t> check_res = CrcParser::parse(crc_start, this->buf + this->len);
+    if (check_res.err)
+      this->res = check_res;
+    else if (check_res.result != this->crc)
+      this->res = ParseResult<void>().fail((const __FlashStringHelper *) CHECKSUM_MISMATCH, crc_start);
+    else if (!this->res.err)
+      // Skip the / and stop at the !
+      this->res = P1Parser::parse_data(this->data, this->buf + 1, crc_start - 1, this->unknown_error);
+    this->res.next = check_res.next;
+    this->state = State::DONE;
+  }
+
+  char *buf;
+  size_t size;
+  Data *data = nullptr;
+  State state = State::DONE;
+  size_t len = 0;
+  // Start of the line currently being received, or of the checksum
+  size_t line_start = 0;
+  // The checksum covers everything before crc_pos
+  uint16_t crc = 0;
+  size_t crc_pos = 0;
+  ParseResult<void> res;
+};
+
 }  // namespace dsmr
 
 #endif  // DSMR_INCLUDE_PARSER_H
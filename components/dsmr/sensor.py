@@ -7,7 +7,9 @@ from esphome.const import (
     DEVICE_CLASS_ENERGY,
     DEVICE_CLASS_POWER,
     DEVICE_CLASS_VOLTAGE,
+    CONF_INTERVAL,
     ICON_EMPTY,
+    LAST_RESET_TYPE_AUTO,
     LAST_RESET_TYPE_NEVER,
     STATE_CLASS_MEASUREMENT,
     STATE_CLASS_NONE,
@@ -17,15 +19,89 @@ from esphome.const import (
     UNIT_WATT_HOURS,
     UNIT_WATT,
 )
-from . import DSMR, CONF_DSMR_ID
+from . import DSMR, CONF_DSMR_ID, configured_fields
 
 AUTO_LOAD = ["dsmr"]
 
+CONF_DEADBAND = "deadband"
+CONF_PRIORITY = "priority"
+CONF_INT_UNIT = "int_unit"
+CONF_HISTORY_LENGTH = "history_length"
+CONF_AGGREGATE = "aggregate"
+AGGREGATES = ["min", "max", "mean", "delta"]
+
+
+def _validate_deadband(value):
+    if isinstance(value, str) and value.endswith("%"):
+        return {"absolute": 0.0, "relative": cv.percentage(value)}
+    return {"absolute": cv.positive_float(value), "relative": 0.0}
+
+
+# Diagnostic sensors about the component itself, rather than the meter.
+# The counters only increase, until they start over from 0 on a reboot.
+_COUNTER_SCHEMA = sensor.sensor_schema(
+    UNIT_EMPTY,
+    "mdi:counter",
+    0,
+    DEVICE_CLASS_EMPTY,
+    STATE_CLASS_MEASUREMENT,
+    LAST_RESET_TYPE_AUTO,
+)
+_TIME_SCHEMA = sensor.sensor_schema(
+    "µs", "mdi:timer-outline", 0, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
+)
+_LENGTH_SCHEMA = sensor.sensor_schema(
+    "B", ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
+)
+DIAGNOSTIC_SENSORS = {
+    "telegrams": _COUNTER_SCHEMA,
+    "crc_failures": _COUNTER_SCHEMA,
+    "parse_failures": _COUNTER_SCHEMA,
+    "buffer_overflows": _COUNTER_SCHEMA,
+    "decrypt_failures": _COUNTER_SCHEMA,
+    "receive_time": _TIME_SCHEMA,
+    "receive_time_max": _TIME_SCHEMA,
+    "decrypt_time": _TIME_SCHEMA,
+    "decrypt_time_max": _TIME_SCHEMA,
+    "parse_time": _TIME_SCHEMA,
+    "parse_time_max": _TIME_SCHEMA,
+    "publish_time": _TIME_SCHEMA,
+    "publish_time_max": _TIME_SCHEMA,
+    "telegram_length": _LENGTH_SCHEMA,
+    "telegram_length_max": _LENGTH_SCHEMA,
+}
+
+
+def _sensor_schema(unit, icon, accuracy, device_class, *args):
+    # Aggregates are measurements in the unit of the field itself
+    aggregate_schema = sensor.sensor_schema(
+        unit, icon, accuracy, device_class, STATE_CLASS_MEASUREMENT
+    )
+    return sensor.sensor_schema(unit, icon, accuracy, device_class, *args).extend(
+        {
+            cv.Optional(CONF_DEADBAND): _validate_deadband,
+            cv.Optional(CONF_PRIORITY, default=False): cv.boolean,
+            cv.Optional(CONF_INT_UNIT, default=False): cv.boolean,
+            cv.Optional(CONF_HISTORY_LENGTH, default=0): cv.int_range(
+                min=0, max=65535
+            ),
+            cv.Optional(CONF_AGGREGATE): cv.Schema(
+                {
+                    cv.Optional(CONF_INTERVAL, default="1min"): cv.All(
+                        cv.positive_time_period_milliseconds,
+                        cv.Range(min=cv.TimePeriod(seconds=1)),
+                    ),
+                    **{cv.Optional(key): aggregate_schema for key in AGGREGATES},
+                }
+            ),
+        }
+    )
+
 
 CONFIG_SCHEMA = cv.Schema(
     {
         cv.GenerateID(CONF_DSMR_ID): cv.use_id(DSMR),
-        cv.Optional("energy_delivered_lux"): sensor.sensor_schema(
+        cv.Optional("energy_delivered_lux"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -33,7 +109,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("energy_delivered_tariff1"): sensor.sensor_schema(
+        cv.Optional("energy_delivered_tariff1"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -41,7 +117,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER
         ),
-        cv.Optional("energy_delivered_tariff2"): sensor.sensor_schema(
+        cv.Optional("energy_delivered_tariff2"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -49,7 +125,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("energy_returned_lux"): sensor.sensor_schema(
+        cv.Optional("energy_returned_lux"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -57,7 +133,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("energy_returned_tariff1"): sensor.sensor_schema(
+        cv.Optional("energy_returned_tariff1"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -65,7 +141,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("energy_returned_tariff2"): sensor.sensor_schema(
+        cv.Optional("energy_returned_tariff2"): _sensor_schema(
             "kWh",
             ICON_EMPTY,
             3,
@@ -73,109 +149,109 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("total_imported_energy"): sensor.sensor_schema(
+        cv.Optional("total_imported_energy"): _sensor_schema(
             "kvarh", ICON_EMPTY, 3, DEVICE_CLASS_ENERGY, STATE_CLASS_NONE
         ),
-        cv.Optional("total_exported_energy"): sensor.sensor_schema(
+        cv.Optional("total_exported_energy"): _sensor_schema(
             "kvarh", ICON_EMPTY, 3, DEVICE_CLASS_ENERGY, STATE_CLASS_NONE
         ),
-        cv.Optional("power_delivered"): sensor.sensor_schema(
+        cv.Optional("power_delivered"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_returned"): sensor.sensor_schema(
+        cv.Optional("power_returned"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_delivered"): sensor.sensor_schema(
+        cv.Optional("reactive_power_delivered"): _sensor_schema(
             "kvar", ICON_EMPTY, 3, DEVICE_CLASS_ENERGY, STATE_CLASS_NONE
         ),
-        cv.Optional("reactive_power_returned"): sensor.sensor_schema(
+        cv.Optional("reactive_power_returned"): _sensor_schema(
             "kvar", ICON_EMPTY, 3, DEVICE_CLASS_ENERGY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("electricity_threshold"): sensor.sensor_schema(
+        cv.Optional("electricity_threshold"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_switch_position"): sensor.sensor_schema(
+        cv.Optional("electricity_switch_position"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_failures"): sensor.sensor_schema(
+        cv.Optional("electricity_failures"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_long_failures"): sensor.sensor_schema(
+        cv.Optional("electricity_long_failures"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_sags_l1"): sensor.sensor_schema(
+        cv.Optional("electricity_sags_l1"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_sags_l2"): sensor.sensor_schema(
+        cv.Optional("electricity_sags_l2"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("electricity_sags_l3"): sensor.sensor_schema(
+        cv.Optional("electricity_sags_l3"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_swells_l1"): sensor.sensor_schema(
+        cv.Optional("electricity_swells_l1"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("electricity_swells_l2"): sensor.sensor_schema(
+        cv.Optional("electricity_swells_l2"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("electricity_swells_l3"): sensor.sensor_schema(
+        cv.Optional("electricity_swells_l3"): _sensor_schema(
             UNIT_EMPTY, ICON_EMPTY, 0, DEVICE_CLASS_EMPTY, STATE_CLASS_NONE
         ),
-        cv.Optional("current_l1"): sensor.sensor_schema(
+        cv.Optional("current_l1"): _sensor_schema(
             UNIT_AMPERE, ICON_EMPTY, 1, DEVICE_CLASS_CURRENT, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("current_l2"): sensor.sensor_schema(
+        cv.Optional("current_l2"): _sensor_schema(
             UNIT_AMPERE, ICON_EMPTY, 1, DEVICE_CLASS_CURRENT, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("current_l3"): sensor.sensor_schema(
+        cv.Optional("current_l3"): _sensor_schema(
             UNIT_AMPERE, ICON_EMPTY, 1, DEVICE_CLASS_CURRENT, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_delivered_l1"): sensor.sensor_schema(
+        cv.Optional("power_delivered_l1"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_delivered_l2"): sensor.sensor_schema(
+        cv.Optional("power_delivered_l2"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_delivered_l3"): sensor.sensor_schema(
+        cv.Optional("power_delivered_l3"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_returned_l1"): sensor.sensor_schema(
+        cv.Optional("power_returned_l1"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_returned_l2"): sensor.sensor_schema(
+        cv.Optional("power_returned_l2"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("power_returned_l3"): sensor.sensor_schema(
+        cv.Optional("power_returned_l3"): _sensor_schema(
             UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_delivered_l1"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_delivered_l1"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_delivered_l2"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_delivered_l2"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_delivered_l3"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_delivered_l3"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_returned_l1"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_returned_l1"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_returned_l2"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_returned_l2"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("reactive_power_returned_l3"): sensor.sensor_schema(
-            UNIT_WATT, ICON_EMPTY, 3, DEVICE_CLASS_POWER, STATE_CLASS_MEASUREMENT
+        cv.Optional("reactive_power_returned_l3"): _sensor_schema(
+            "kvar", ICON_EMPTY, 3, DEVICE_CLASS_EMPTY, STATE_CLASS_MEASUREMENT
         ),
-        cv.Optional("voltage_l1"): sensor.sensor_schema(
+        cv.Optional("voltage_l1"): _sensor_schema(
             UNIT_VOLT, ICON_EMPTY, 1, DEVICE_CLASS_VOLTAGE, STATE_CLASS_NONE
         ),
-        cv.Optional("voltage_l2"): sensor.sensor_schema(
+        cv.Optional("voltage_l2"): _sensor_schema(
             UNIT_VOLT, ICON_EMPTY, 1, DEVICE_CLASS_VOLTAGE, STATE_CLASS_NONE
         ),
-        cv.Optional("voltage_l3"): sensor.sensor_schema(
+        cv.Optional("voltage_l3"): _sensor_schema(
             UNIT_VOLT, ICON_EMPTY, 1, DEVICE_CLASS_VOLTAGE, STATE_CLASS_NONE
         ),
-        cv.Optional("gas_delivered"): sensor.sensor_schema(
+        cv.Optional("gas_delivered"): _sensor_schema(
             "m³",
             ICON_EMPTY,
             3,
@@ -183,7 +259,7 @@ CONFIG_SCHEMA = cv.Schema(
             STATE_CLASS_MEASUREMENT,
             LAST_RESET_TYPE_NEVER,
         ),
-        cv.Optional("gas_delivered_be"): sensor.sensor_schema(
+        cv.Optional("gas_delivered_be"): _sensor_schema(
             "m³",
             ICON_EMPTY,
             3,
@@ -192,20 +268,58 @@ CONFIG_SCHEMA = cv.Schema(
             LAST_RESET_TYPE_NEVER
         ),
     }
+).extend(
+    {cv.Optional(key): schema for key, schema in DIAGNOSTIC_SENSORS.items()}
 ).extend(cv.COMPONENT_SCHEMA)
 
 
 def to_code(config):
     hub = yield cg.get_variable(config[CONF_DSMR_ID])
 
-    sensors = []
     for key, conf in config.items():
         if not isinstance(conf, dict):
             continue
         id = conf.get("id")
-        if id and id.type == sensor.Sensor:
+        if key in DIAGNOSTIC_SENSORS:
+            s = yield sensor.new_sensor(conf)
+            cg.add(getattr(hub, f"set_{key}_sensor")(s))
+        elif id and id.type == sensor.Sensor:
             s = yield sensor.new_sensor(conf)
             cg.add(getattr(hub, f"set_{key}")(s))
-            sensors.append(f"F({key})")
+            if conf[CONF_PRIORITY]:
+                cg.add(getattr(hub, f"set_{key}_priority")(True))
+            if conf[CONF_HISTORY_LENGTH]:
+                cg.add(
+                    getattr(hub, f"set_{key}_history_length")(conf[CONF_HISTORY_LENGTH])
+                )
+            if CONF_AGGREGATE in conf:
+                aggregate = conf[CONF_AGGREGATE]
+                sensors = []
+                for name in AGGREGATES:
+                    if name in aggregate:
+                        a = yield sensor.new_sensor(aggregate[name])
+                        sensors.append(a)
+                    else:
+                        sensors.append(cg.nullptr)
+                cg.add(
+                    getattr(hub, f"set_{key}_aggregate")(
+                        aggregate[CONF_INTERVAL], *sensors
+                    )
+                )
+            # After the aggregate, which is published in the same unit
+            if conf[CONF_INT_UNIT]:
+                cg.add(getattr(hub, f"set_{key}_int_unit")(True))
+            # After int_unit, as the deadband is in the published unit
+            if CONF_DEADBAND in conf:
+                deadband = conf[CONF_DEADBAND]
+                cg.add(
+                    getattr(hub, f"set_{key}_deadband")(
+                        deadband["absolute"], deadband["relative"]
+                    )
+                )
 
+    sensors = [
+        f"F({key})"
+        for key in configured_fields("sensor", sensor.Sensor, DIAGNOSTIC_SENSORS)
+    ]
     cg.add_define("DSMR_SENSOR_LIST(F, sep)", cg.RawExpression(" sep ".join(sensors)))
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+namespace esphome {
+namespace dsmr_ {
+
+// Lock-free queue of up to N values, for a single producer and a single
+// consumer that may run in different tasks.
+template<typename T, size_t N> class SpscQueue {
+ public:
+  // Adds a value, returns false when the queue is full. Only call this
+  // from the producer.
+  bool push(const T &value) {
+    const size_t head = this->head_.load(std::memory_order_relaxed);
+    const size_t next = (head + 1) % SIZE;
+    if (next == this->tail_.load(std::memory_order_acquire))
+      return false;
+    this->values_[head] = value;
+    this->head_.store(next, std::memory_order_release);
+    return true;
+  }
+
+  // Removes the oldest value, returns false when the queue is empty. Only
+  // call this from the consumer.
+  bool pop(T &value) {
+    const size_t tail = this->tail_.load(std::memory_order_relaxed);
+    if (tail == this->head_.load(std::memory_order_acquire))
+      return false;
+    value = this->values_[tail];
+    this->tail_.store((tail + 1) % SIZE, std::memory_order_release);
+    return true;
+  }
+
+ protected:
+  // One slot is always left empty, to tell a full queue from an empty one
+  static constexpr size_t SIZE = N + 1;
+
+  T values_[SIZE];
+  // Written by the producer only
+  std::atomic<size_t> head_{0};
+  // Written by the consumer only
+  std::atomic<size_t> tail_{0};
+};
+
+}  // namespace dsmr_
+}  // namespace esphome
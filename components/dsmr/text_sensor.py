@@ -7,7 +7,7 @@ from esphome.const import (
     ICON_EMPTY,
     UNIT_WATT_HOURS,
 )
-from . import DSMR, CONF_DSMR_ID
+from . import DSMR, CONF_DSMR_ID, configured_fields
 
 AUTO_LOAD = ["dsmr"]
 
@@ -81,7 +81,6 @@ CONFIG_SCHEMA = cv.Schema(
 def to_code(config):
     hub = yield cg.get_variable(config[CONF_DSMR_ID])
 
-    text_sensors = []
     for key, conf in config.items():
         if not isinstance(conf, dict):
             continue
@@ -90,8 +89,10 @@ def to_code(config):
             var = cg.new_Pvariable(conf[CONF_ID])
             yield text_sensor.register_text_sensor(var, conf)
             cg.add(getattr(hub, f"set_{key}")(var))
-            text_sensors.append(f"F({key})")
 
+    text_sensors = [
+        f"F({key})" for key in configured_fields("text_sensor", text_sensor.TextSensor)
+    ]
     cg.add_define(
         "DSMR_TEXT_SENSOR_LIST(F, sep)", cg.RawExpression(" sep ".join(text_sensors))
     )
@@ -165,6 +165,24 @@ struct ParseResult : public _ParseResult<ParseResult<T>, T> {
   }
 };
 
+/**
+ * A piece of text in the message being parsed. Instead of copying the
+ * characters into a String, this just points at them, so parsing text
+ * fields does not need any heap allocations. This means a StringView is
+ * only valid as long as the parsed message is, and that it is not
+ * nul-terminated.
+ */
+struct StringView {
+  const char *ptr = nullptr;
+  size_t len = 0;
+
+  StringView() = default;
+  StringView(const char *ptr, size_t len) : ptr(ptr), len(len) { }
+
+  const char *data() const { return ptr; }
+  size_t length() const { return len; }
+};
+
 /**
  * An OBIS id is 6 bytes, usually noted as a-b:c.d.e.f. Here we put them
  * in an array for easy parsing.
@@ -179,6 +197,12 @@ struct ObisId {
   bool operator==(const ObisId &other) const {
     return memcmp(&v, &other.v, sizeof(v)) == 0;
   }
+
+  // The id packed into a single integer, for cheap comparing and sorting
+  constexpr uint64_t key() const {
+    return (uint64_t) v[0] << 40 | (uint64_t) v[1] << 32 | (uint32_t) v[2] << 24 | (uint32_t) v[3] << 16 |
+           (uint32_t) v[4] << 8 | v[5];
+  }
 };
 
 } // namespace dsmr